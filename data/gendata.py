@@ -8,9 +8,10 @@
 # //
 # //   Created On: 05/01/2018
 # //   Created By: Vishnu Boddeti <mailto:vishnu@msu.edu>
-# //   Modified On: 03/01/2020
+# //   Modified On: 10/17/2026
 # ////////////////////////////////////////////////////////////////////////////
 
+import sys
 import struct
 import numpy as np
 
@@ -25,7 +26,8 @@ def write_to_file(name, data, siz):
 
 
 dim = 512
-num1 = 16
+# the gallery size can be given, e.g. a full 1:N block of slot_count templates
+num1 = int(sys.argv[1]) if len(sys.argv) > 1 else 16
 num2 = 16
 
 data1 = np.float32(np.random.randn(num1, dim))
@@ -0,0 +1,370 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : benchmark.cpp
+//   Description : per-stage microbenchmarks of the matching pipeline, every
+//                 scheme, layout and security preset on fixed-seed synthetic
+//                 templates, nanosecond percentiles written as JSON
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <thread>
+#include <cmath>
+
+#include "seal/seal.h"
+#include "match_engine.h"
+
+using namespace std;
+using namespace seal;
+
+namespace
+{
+    struct Preset
+    {
+        string name;
+        scheme_type scheme;
+        MatchMode mode;
+        GalleryLayout layout;
+        ProbeFormat probe_format;
+    };
+
+    struct StageResult
+    {
+        string preset;
+        int security_level;
+        size_t poly_modulus_degree;
+        string stage;
+        vector<double> samples;
+    };
+
+    /*
+    Times body() iterations times, setup() runs before every call and is not
+    timed. Samples are in nanoseconds.
+    */
+    vector<double> measure(int iterations, const function<void()> &setup, const function<void()> &body)
+    {
+        vector<double> samples;
+        for (int i=0; i < iterations; i++)
+        {
+            setup();
+            auto time_start = chrono::steady_clock::now();
+            body();
+            auto time_end = chrono::steady_clock::now();
+            samples.push_back(double(chrono::duration_cast<chrono::nanoseconds>(time_end - time_start).count()));
+        }
+        sort(samples.begin(), samples.end());
+        return samples;
+    }
+
+    // nearest-rank percentile of sorted samples
+    double percentile(const vector<double> &sorted, double p)
+    {
+        size_t rank = size_t(ceil(p / 100 * double(sorted.size())));
+        return sorted[min(sorted.size() - 1, rank ? rank - 1 : 0)];
+    }
+
+    /*
+    Unit-norm Gaussian templates, the same for a given seed on every machine.
+    */
+    vector<vector<float>> synthetic_features(int num, int dim, unsigned int seed)
+    {
+        mt19937 generator(seed);
+        normal_distribution<float> normal(0.0f, 1.0f);
+        vector<vector<float>> features(num, vector<float>(dim));
+        for (auto &feature : features)
+        {
+            float norm = 0;
+            for (auto &value : feature)
+            {
+                value = normal(generator);
+                norm += value * value;
+            }
+            for (auto &value : feature)
+            {
+                value /= sqrt(norm);
+            }
+        }
+        return features;
+    }
+
+    void write_json(const string &name, int iterations, int dim, int num_gallery, const vector<StageResult> &results)
+    {
+        ofstream ofile(name);
+        if (ofile.fail())
+        {
+            throw runtime_error("cannot write " + name);
+        }
+        ofile << fixed << setprecision(0);
+        ofile << "{" << endl;
+        ofile << "  \"seal_version\": \"" << SEAL_VERSION << "\"," << endl;
+        ofile << "  \"hardware_concurrency\": " << thread::hardware_concurrency() << "," << endl;
+        ofile << "  \"iterations\": " << iterations << "," << endl;
+        ofile << "  \"dim\": " << dim << "," << endl;
+        ofile << "  \"num_gallery\": " << num_gallery << "," << endl;
+        ofile << "  \"results\": [" << endl;
+        for (size_t i=0; i < results.size(); i++)
+        {
+            const StageResult &result = results[i];
+            double mean = 0;
+            for (double sample : result.samples)
+            {
+                mean += sample / double(result.samples.size());
+            }
+            ofile << "    { \"preset\": \"" << result.preset << "\", \"security_level\": " << result.security_level
+                << ", \"poly_modulus_degree\": " << result.poly_modulus_degree << ", \"stage\": \"" << result.stage << "\""
+                << ", \"min_ns\": " << result.samples.front() << ", \"p50_ns\": " << percentile(result.samples, 50)
+                << ", \"p90_ns\": " << percentile(result.samples, 90) << ", \"p99_ns\": " << percentile(result.samples, 99)
+                << ", \"max_ns\": " << result.samples.back() << ", \"mean_ns\": " << mean << " }"
+                << ((i + 1 < results.size()) ? "," : "") << endl;
+        }
+        ofile << "  ]" << endl;
+        ofile << "}" << endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    auto usage = [&]() {
+        cout << "usage: " << argv[0] << " <iterations> <output json> [--dim D] [--gallery N] [--scheme bfv|ckks] [--security L] [--rotation-base B]" << endl;
+        return 1;
+    };
+    if (argc < 3)
+    {
+        return usage();
+    }
+    int iterations = max(1, atoi(argv[1]));
+    string output = argv[2];
+    int dim = 512;
+    int num_gallery = 16;
+    string only_scheme;
+    int only_security = 0;
+    size_t rotation_base = 2;
+    for (int i=3; i < argc; i += 2)
+    {
+        string option = argv[i];
+        if (i + 1 == argc)
+        {
+            cout << "option " << option << " needs a value" << endl;
+            return usage();
+        }
+        if (option == "--dim")
+        {
+            dim = atoi(argv[i + 1]);
+        }
+        else if (option == "--gallery")
+        {
+            num_gallery = atoi(argv[i + 1]);
+        }
+        else if (option == "--scheme")
+        {
+            only_scheme = argv[i + 1];
+        }
+        else if (option == "--security")
+        {
+            only_security = atoi(argv[i + 1]);
+        }
+        else if (option == "--rotation-base")
+        {
+            rotation_base = size_t(atoi(argv[i + 1]));
+        }
+        else
+        {
+            cout << "unknown option " << option << endl;
+            return usage();
+        }
+    }
+
+    vector<Preset> presets = {
+        { "bfv_1_to_1", scheme_type::bfv, MatchMode::one_to_one, GalleryLayout::standard, ProbeFormat::broadcast },
+        { "bfv_1_to_1_packed", scheme_type::bfv, MatchMode::one_to_one, GalleryLayout::packed, ProbeFormat::broadcast },
+        { "bfv_1_to_n", scheme_type::bfv, MatchMode::one_to_n, GalleryLayout::standard, ProbeFormat::broadcast },
+        { "bfv_1_to_n_packed_probe", scheme_type::bfv, MatchMode::one_to_n, GalleryLayout::standard, ProbeFormat::packed },
+        { "bfv_1_to_n_replicated", scheme_type::bfv, MatchMode::one_to_n, GalleryLayout::replicated, ProbeFormat::broadcast },
+        { "ckks_1_to_1", scheme_type::ckks, MatchMode::one_to_one, GalleryLayout::standard, ProbeFormat::broadcast },
+        { "ckks_1_to_1_packed", scheme_type::ckks, MatchMode::one_to_one, GalleryLayout::packed, ProbeFormat::broadcast },
+        { "ckks_1_to_n", scheme_type::ckks, MatchMode::one_to_n, GalleryLayout::standard, ProbeFormat::broadcast },
+        { "ckks_1_to_n_packed_probe", scheme_type::ckks, MatchMode::one_to_n, GalleryLayout::standard, ProbeFormat::packed },
+        { "ckks_1_to_n_replicated", scheme_type::ckks, MatchMode::one_to_n, GalleryLayout::replicated, ProbeFormat::broadcast }
+    };
+
+    // fixed seeds, the same data on every run
+    vector<vector<float>> gallery = synthetic_features(num_gallery, dim, 2018);
+    vector<float> probe = synthetic_features(1, dim, 2020)[0];
+    filesystem::path scratch = filesystem::temp_directory_path() / "secure-face-matching-benchmark";
+
+    vector<StageResult> results;
+    for (const Preset &preset : presets)
+    {
+        bool bfv = (preset.scheme == scheme_type::bfv);
+        if (!only_scheme.empty() and only_scheme != (bfv ? "bfv" : "ckks"))
+        {
+            continue;
+        }
+        for (int security_level : { 128, 192, 256 })
+        {
+            if (only_security and only_security != security_level)
+            {
+                continue;
+            }
+
+            MatchConfig config = default_config(preset.scheme, preset.mode, security_level);
+            config.layout = preset.layout;
+            config.probe_format = preset.probe_format;
+            config.verbose = false;
+            config.key_dir = (scratch / "keys/").string();
+            config.gallery_dir = (scratch / "gallery/").string();
+            config.rotation_base = rotation_base;
+
+            EncryptionParameters parms = make_parameters(config);
+            SEALContext context(parms, true, to_sec_level(security_level));
+            size_t n = parms.poly_modulus_degree();
+            cout << "Benchmarking " << preset.name << " at " << security_level << " bits, poly_modulus_degree " << n << endl;
+            auto record = [&](const string &stage, const function<void()> &setup, const function<void()> &body) {
+                results.push_back({ preset.name, security_level, n, stage, measure(iterations, setup, body) });
+                cout << "    " << setw(16) << left << stage << " p50 " << setw(12) << right << fixed << setprecision(0)
+                    << percentile(results.back().samples, 50) << " ns  p99 " << setw(12) << percentile(results.back().samples, 99) << " ns" << endl;
+            };
+            auto nothing = []() {};
+
+            // rotation steps with Galois keys, the same the engine generates
+            // for the layout and the rotation base
+            MatchEngine engine(config);
+            size_t slot_count = bfv ? n : n / 2;
+            vector<int> steps;
+            if (engine.uses_galois_keys())
+            {
+                steps = engine.galois_steps(dim);
+            }
+
+            KeyGenerator keygen(context);
+            SecretKey secret_key = keygen.secret_key();
+            PublicKey public_key;
+            RelinKeys relin_key;
+            GaloisKeys gal_key;
+            keygen.create_public_key(public_key);
+            keygen.create_relin_keys(relin_key);
+            if (!steps.empty())
+            {
+                keygen.create_galois_keys(steps, gal_key);
+            }
+            Encryptor encryptor(context, public_key);
+            Evaluator evaluator(context);
+            Decryptor decryptor(context, secret_key);
+            unique_ptr<BatchEncoder> batch_encoder;
+            unique_ptr<CKKSEncoder> ckks_encoder;
+            if (bfv)
+            {
+                batch_encoder = make_unique<BatchEncoder>(context);
+            }
+            else
+            {
+                ckks_encoder = make_unique<CKKSEncoder>(context);
+            }
+
+            // primitive stages on one gallery template and the probe
+            Plaintext plain_gallery, plain_probe, plain_result;
+            auto encode = [&](const vector<float> &values, double scale, Plaintext &plain) {
+                if (bfv)
+                {
+                    vector<int64_t> pod_matrix(slot_count, 0);
+                    for (size_t j=0; j < values.size(); j++)
+                    {
+                        pod_matrix[j] = (int64_t) roundf(config.precision*values[j]);
+                    }
+                    batch_encoder->encode(pod_matrix, plain);
+                }
+                else
+                {
+                    vector<double> pod_vector(values.begin(), values.end());
+                    pod_vector.resize(slot_count, 0.0);
+                    ckks_encoder->encode(pod_vector, scale, plain);
+                }
+            };
+            record("encode", nothing, [&]() { encode(gallery[0], config.gallery_scale, plain_gallery); });
+            encode(probe, config.probe_scale, plain_probe);
+
+            Ciphertext encrypted_gallery, encrypted_probe, product, result, temp;
+            record("encrypt", nothing, [&]() { encryptor.encrypt(plain_gallery, encrypted_gallery); });
+            encryptor.encrypt(plain_probe, encrypted_probe);
+
+            record("multiply", nothing, [&]() { evaluator.multiply(encrypted_probe, encrypted_gallery, product); });
+            record("relinearize", [&]() { result = product; }, [&]() { evaluator.relinearize_inplace(result, relin_key); });
+            if (!bfv)
+            {
+                record("rescale", [&]() { temp = result; }, [&]() { evaluator.rescale_to_next_inplace(temp); });
+            }
+            for (int step : steps)
+            {
+                record("rotate_" + to_string(step), nothing, [&]() {
+                    if (bfv)
+                    {
+                        evaluator.rotate_rows(result, step, gal_key, temp);
+                    }
+                    else
+                    {
+                        evaluator.rotate_vector(result, step, gal_key, temp);
+                    }
+                });
+            }
+            record("add", [&]() { temp = result; }, [&]() { evaluator.add_inplace(temp, result); });
+            if (!steps.empty())
+            {
+                record("multiply_plain", nothing, [&]() { evaluator.multiply_plain(encrypted_gallery, plain_gallery, temp); });
+            }
+            if (context.first_parms_id() != context.last_parms_id())
+            {
+                record("mod_switch", nothing, [&]() { evaluator.mod_switch_to(result, context.last_parms_id(), temp); });
+            }
+            record("decrypt", nothing, [&]() { decryptor.decrypt(result, plain_result); });
+            record("decode", nothing, [&]() {
+                if (bfv)
+                {
+                    vector<int64_t> pod_result;
+                    batch_encoder->decode(plain_result, pod_result);
+                }
+                else
+                {
+                    vector<double> pod_result;
+                    ckks_encoder->decode(plain_result, pod_result);
+                }
+            });
+
+            // the whole pipeline through the engine against a synthetic gallery
+            engine.generate_keys(dim);
+            engine.enroll(gallery);
+            EncryptedProbe engine_probe;
+            EncryptedScores engine_scores;
+            if (preset.layout == GalleryLayout::replicated)
+            {
+                // a full batch of probes, one per copy of the gallery, in one pass
+                vector<vector<float>> batch(engine.probes_per_batch(), probe);
+                record("encrypt_probes", nothing, [&]() { engine_probe = engine.encrypt_probes(batch); });
+                record("match", nothing, [&]() { engine_scores = engine.match(engine_probe); });
+                record("decrypt_batch_scores", nothing, [&]() { engine.decrypt_batch_scores(engine_scores, batch.size()); });
+            }
+            else
+            {
+                record("encrypt_probe", nothing, [&]() { engine_probe = engine.encrypt_probe(probe); });
+                record("match", nothing, [&]() { engine_scores = engine.match(engine_probe); });
+                record("decrypt_scores", nothing, [&]() { engine.decrypt_scores(engine_scores); });
+            }
+        }
+    }
+
+    filesystem::remove_all(scratch);
+    write_json(output, iterations, dim, num_gallery, results);
+    cout << "Saved to " << output << endl;
+    return 0;
+}
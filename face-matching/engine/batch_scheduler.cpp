@@ -0,0 +1,136 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : batch_scheduler.cpp
+//   Description : micro-batching scheduler in front of the matching engine
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "seal/seal.h"
+#include "batch_scheduler.h"
+
+using namespace std;
+using namespace seal;
+
+BatchScheduler::BatchScheduler(const MatchEngine &engine, size_t max_batch, chrono::microseconds deadline)
+    : engine_(engine), max_batch_(max(size_t(1), max_batch)), deadline_(deadline)
+{
+    thread_ = thread(&BatchScheduler::run, this);
+}
+
+BatchScheduler::~BatchScheduler()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    arrived_.notify_all();
+    thread_.join();
+}
+
+EncryptedScores BatchScheduler::match(EncryptedProbe probe)
+{
+    future<EncryptedScores> scores;
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (stopping_)
+        {
+            throw logic_error("the scheduler is shutting down");
+        }
+        pending_.push_back(Request{ move(probe), promise<EncryptedScores>(), chrono::steady_clock::now() });
+        scores = pending_.back().scores.get_future();
+    }
+    arrived_.notify_all();
+    return scores.get();
+}
+
+Ciphertext BatchScheduler::verify(const EncryptedProbe &probe, int identity)
+{
+    lock_guard<mutex> lock(engine_mutex_);
+    return engine_.verify(probe, identity);
+}
+
+void BatchScheduler::run()
+{
+    while (true)
+    {
+        vector<Request> batch;
+        {
+            // wait for a first probe, then for the batch to fill or its
+            // deadline to pass
+            unique_lock<mutex> lock(mutex_);
+            arrived_.wait(lock, [&]() { return stopping_ or !pending_.empty(); });
+            if (pending_.empty())
+            {
+                return;
+            }
+            auto closes = pending_.front().arrival + deadline_;
+            arrived_.wait_until(lock, closes, [&]() { return stopping_ or pending_.size() >= max_batch_; });
+
+            size_t count = min(max_batch_, pending_.size());
+            auto now = chrono::steady_clock::now();
+            for (size_t i=0; i < count; i++)
+            {
+                double wait_ms = chrono::duration<double, milli>(now - pending_.front().arrival).count();
+                total_wait_ms_ += wait_ms;
+                stats_.max_wait_ms = max(stats_.max_wait_ms, wait_ms);
+                batch.push_back(move(pending_.front()));
+                pending_.pop_front();
+            }
+            stats_.requests += count;
+            stats_.batches++;
+            stats_.max_batch = max(stats_.max_batch, count);
+        }
+
+        // match outside the lock so that the next batch can fill meanwhile
+        try
+        {
+            vector<EncryptedProbe> probes;
+            for (auto &request : batch)
+            {
+                probes.push_back(move(request.probe));
+            }
+            vector<EncryptedScores> scores;
+            {
+                lock_guard<mutex> lock(engine_mutex_);
+                scores = engine_.match_batch(probes);
+            }
+            for (size_t i=0; i < batch.size(); i++)
+            {
+                batch[i].scores.set_value(move(scores[i]));
+            }
+        }
+        catch (...)
+        {
+            for (auto &request : batch)
+            {
+                request.scores.set_exception(current_exception());
+            }
+        }
+    }
+}
+
+BatchSchedulerStats BatchScheduler::stats() const
+{
+    lock_guard<mutex> lock(mutex_);
+    BatchSchedulerStats stats = stats_;
+    stats.mean_wait_ms = stats.requests ? total_wait_ms_ / double(stats.requests) : 0.0;
+    return stats;
+}
+
+void BatchScheduler::print(ostream &stream) const
+{
+    BatchSchedulerStats stats = this->stats();
+    stream << "Batches: " << stats.batches << " for " << stats.requests << " probes, mean size " << fixed << setprecision(2)
+        << (stats.batches ? double(stats.requests) / double(stats.batches) : 0.0) << ", max size " << stats.max_batch
+        << ", mean wait " << stats.mean_wait_ms << " ms, max wait " << stats.max_wait_ms << " ms" << endl;
+}
@@ -0,0 +1,109 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : gallery_cache.cpp
+//   Description : memory budgeted gallery cache, LRU for lookups and
+//                 pinning for scans
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <iomanip>
+
+#include "seal/seal.h"
+#include "gallery_cache.h"
+
+using namespace std;
+using namespace seal;
+
+GalleryCache::GalleryCache(size_t budget) : budget_(budget)
+{
+}
+
+shared_ptr<const Ciphertext> GalleryCache::get(uint64_t key, const Loader &load, bool scan)
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto found = entries_.find(key);
+        if (found != entries_.end())
+        {
+            hits_++;
+            recency_.splice(recency_.begin(), recency_, found->second.position);
+            return found->second.encrypted;
+        }
+        misses_++;
+    }
+
+    // reading and deserializing happen outside the lock
+    auto encrypted = make_shared<const Ciphertext>(load(key));
+    size_t bytes = footprint(*encrypted);
+
+    lock_guard<mutex> lock(mutex_);
+    auto found = entries_.find(key);
+    if (found != entries_.end())
+    {
+        return found->second.encrypted;
+    }
+    if (bytes > budget_)
+    {
+        return encrypted;
+    }
+    if (scan and bytes_ + bytes > budget_)
+    {
+        bypassed_++;
+        return encrypted;
+    }
+
+    // evict from the least recently used end until the new one fits
+    while (bytes_ + bytes > budget_)
+    {
+        auto victim = entries_.find(recency_.back());
+        bytes_ -= victim->second.bytes;
+        entries_.erase(victim);
+        recency_.pop_back();
+        evictions_++;
+    }
+    recency_.push_front(key);
+    entries_.emplace(key, Entry{ encrypted, bytes, recency_.begin() });
+    bytes_ += bytes;
+    return encrypted;
+}
+
+void GalleryCache::clear()
+{
+    lock_guard<mutex> lock(mutex_);
+    entries_.clear();
+    recency_.clear();
+    bytes_ = 0;
+}
+
+GalleryCacheStats GalleryCache::stats() const
+{
+    lock_guard<mutex> lock(mutex_);
+    GalleryCacheStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.bypassed = bypassed_;
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    stats.budget = budget_;
+    return stats;
+}
+
+void GalleryCache::print(ostream &stream) const
+{
+    GalleryCacheStats stats = this->stats();
+    size_t lookups = stats.hits + stats.misses;
+    stream << "Gallery cache: " << stats.entries << " ciphertexts, " << (stats.bytes >> 20) << " of "
+        << (stats.budget >> 20) << " MB, hits " << stats.hits << ", misses " << stats.misses
+        << ", evictions " << stats.evictions << ", bypassed " << stats.bypassed << ", hit rate " << fixed << setprecision(1)
+        << (lookups ? 100.0 * double(stats.hits) / double(lookups) : 0.0) << "%" << endl;
+}
+
+size_t GalleryCache::footprint(const Ciphertext &encrypted)
+{
+    return encrypted.size() * encrypted.poly_modulus_degree() * encrypted.coeff_modulus_size() * sizeof(uint64_t);
+}
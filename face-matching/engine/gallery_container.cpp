@@ -0,0 +1,356 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : gallery_container.cpp
+//   Description : single-file indexed container for an encrypted gallery
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gallery_container.h"
+
+using namespace std;
+using namespace seal;
+
+namespace
+{
+    void write_fully(int fd, const void *data, size_t size, uint64_t offset, const string &name)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t written = pwrite(fd, bytes, size, off_t(offset));
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw runtime_error("cannot write " + name + ": " + strerror(errno));
+            }
+            bytes += written;
+            size -= size_t(written);
+            offset += uint64_t(written);
+        }
+    }
+}
+
+void GalleryContainer::create(const string &name, const GalleryHeader &header)
+{
+    int fd = open(name.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw runtime_error("cannot write " + name + ": " + strerror(errno));
+    }
+
+    GalleryHeader empty = header;
+    empty.table_offset = sizeof(GalleryHeader);
+    empty.table_count = 0;
+    write_fully(fd, &empty, sizeof(empty), 0, name);
+    fsync(fd);
+    close(fd);
+}
+
+GalleryContainer::GalleryContainer(const string &name, bool writable)
+    : name_(name), writable_(writable), mapping_(name)
+{
+    if (writable_)
+    {
+        fd_ = open(name.c_str(), O_RDWR);
+        if (fd_ < 0)
+        {
+            throw runtime_error("cannot open " + name + ": " + strerror(errno));
+        }
+    }
+    read_table();
+}
+
+GalleryContainer::~GalleryContainer()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+void GalleryContainer::read_table()
+{
+    if (mapping_.size() < sizeof(GalleryHeader))
+    {
+        throw runtime_error(name_ + " is not a gallery container");
+    }
+    memcpy(&header_, mapping_.data(), sizeof(GalleryHeader));
+    if (memcmp(header_.magic, "SFMG", 4) != 0)
+    {
+        throw runtime_error(name_ + " is not a gallery container");
+    }
+    if (header_.version != GalleryHeader().version)
+    {
+        throw runtime_error(name_ + " has unsupported container version " + to_string(header_.version));
+    }
+    if (header_.table_offset + header_.table_count * sizeof(GalleryEntry) > mapping_.size())
+    {
+        throw runtime_error(name_ + " is truncated");
+    }
+
+    index_.clear();
+    order_.clear();
+    for (uint64_t i=0; i < header_.table_count; i++)
+    {
+        GalleryEntry entry;
+        memcpy(&entry, mapping_.data() + header_.table_offset + i * sizeof(GalleryEntry), sizeof(GalleryEntry));
+        if (entry.offset + entry.size > header_.table_offset)
+        {
+            throw runtime_error(name_ + " has a corrupt offset table");
+        }
+        index_[entry.key] = entry;
+        order_.push_back(entry.key);
+    }
+
+    // appends go after the table currently in effect
+    end_ = committed_end();
+    count_dead();
+}
+
+void GalleryContainer::count_dead()
+{
+    uint64_t live = sizeof(GalleryHeader) + header_.table_count * sizeof(GalleryEntry);
+    for (const auto &entry : index_)
+    {
+        live += entry.second.size;
+    }
+    dead_ = committed_end() - live;
+}
+
+pair<const seal_byte *, size_t> GalleryContainer::payload(uint64_t key) const
+{
+    auto it = index_.find(key);
+    if (it == index_.end())
+    {
+        throw out_of_range(name_ + " has no entry " + to_string(key));
+    }
+    if (it->second.offset + it->second.size > mapping_.size())
+    {
+        throw logic_error("entry " + to_string(key) + " has not been committed");
+    }
+    return { mapping_.data() + it->second.offset, size_t(it->second.size) };
+}
+
+void GalleryContainer::append_bytes(uint64_t key, const seal_byte *data, size_t size)
+{
+    if (!writable_)
+    {
+        throw logic_error(name_ + " was not opened for writing");
+    }
+    write_fully(fd_, data, size, end_, name_);
+
+    GalleryEntry entry = { key, end_, uint64_t(size) };
+    if (index_.count(key) == 0)
+    {
+        order_.push_back(key);
+    }
+    index_[key] = entry;
+    unsynced_.push_back(entry);
+    end_ += size;
+    dirty_ = true;
+}
+
+bool GalleryContainer::replace_bytes(uint64_t key, const seal_byte *data, size_t size)
+{
+    if (!writable_)
+    {
+        throw logic_error(name_ + " was not opened for writing");
+    }
+
+    // only payloads below the table in effect have a slot of their own
+    auto it = index_.find(key);
+    if (it == index_.end() or it->second.offset >= header_.table_offset or size > it->second.size)
+    {
+        return false;
+    }
+    write_fully(fd_, data, size, it->second.offset, name_);
+    it->second.size = uint64_t(size);
+    dirty_ = true;
+    return true;
+}
+
+void GalleryContainer::sync(const string &log)
+{
+    if (!writable_)
+    {
+        throw logic_error(name_ + " was not opened for writing");
+    }
+
+    // the entries are logged only once their payloads are on disk
+    fsync(fd_);
+    int fd = open(log.c_str(), O_WRONLY|O_CREAT, 0644);
+    if (fd < 0)
+    {
+        throw runtime_error("cannot write " + log + ": " + strerror(errno));
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        throw runtime_error("cannot write " + log + ": " + strerror(errno));
+    }
+    try
+    {
+        write_fully(fd, unsynced_.data(), unsynced_.size() * sizeof(GalleryEntry), uint64_t(status.st_size), log);
+    }
+    catch (...)
+    {
+        close(fd);
+        throw;
+    }
+    fsync(fd);
+    close(fd);
+    unsynced_.clear();
+}
+
+void GalleryContainer::recover(const string &log)
+{
+    if (!writable_)
+    {
+        throw logic_error(name_ + " was not opened for writing");
+    }
+    ifstream ifile(log, ios::binary);
+    GalleryEntry entry;
+    while (ifile.read(reinterpret_cast<char *>(&entry), sizeof(entry)))
+    {
+        // a torn tail or payloads lost in a crash end the log
+        if (entry.offset < committed_end() or entry.offset + entry.size > mapping_.size())
+        {
+            break;
+        }
+        if (index_.count(entry.key) == 0)
+        {
+            order_.push_back(entry.key);
+        }
+        index_[entry.key] = entry;
+        end_ = max(end_, entry.offset + entry.size);
+        dirty_ = true;
+    }
+}
+
+void GalleryContainer::commit()
+{
+    if (!writable_)
+    {
+        throw logic_error(name_ + " was not opened for writing");
+    }
+    write_table();
+    if (double(dead_) > compact_fraction * double(committed_end()))
+    {
+        compact();
+    }
+}
+
+void GalleryContainer::write_table()
+{
+    vector<GalleryEntry> table;
+    for (uint64_t key : order_)
+    {
+        table.push_back(index_[key]);
+    }
+
+    // always after the current end, never over the table the header points
+    // at, which stays in effect until the header is rewritten; the old table
+    // is dead bytes for compact()
+    uint64_t offset = end_;
+    write_fully(fd_, table.data(), table.size() * sizeof(GalleryEntry), offset, name_);
+    fsync(fd_);
+
+    // the header switches to the new table only once the table is on disk
+    header_.table_offset = offset;
+    header_.table_count = table.size();
+    write_fully(fd_, &header_, sizeof(GalleryHeader), 0, name_);
+    fsync(fd_);
+
+    // payloads an interrupted run left past the table are of no entry
+    if (ftruncate(fd_, off_t(committed_end())) != 0)
+    {
+        throw runtime_error("cannot truncate " + name_ + ": " + strerror(errno));
+    }
+
+    mapping_ = MappedFile(name_);
+    end_ = committed_end();
+    dirty_ = false;
+    unsynced_.clear();
+    count_dead();
+}
+
+void GalleryContainer::compact()
+{
+    if (!writable_)
+    {
+        throw logic_error(name_ + " was not opened for writing");
+    }
+    if (dirty_)
+    {
+        write_table();
+    }
+
+    // the payloads go back to back in key order, then the table; the
+    // rename replaces the file only once the copy is on disk
+    string temp = name_ + ".compact";
+    int fd = open(temp.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw runtime_error("cannot write " + temp + ": " + strerror(errno));
+    }
+    try
+    {
+        vector<GalleryEntry> table;
+        uint64_t offset = sizeof(GalleryHeader);
+        for (uint64_t key : order_)
+        {
+            GalleryEntry entry = index_[key];
+            write_fully(fd, mapping_.data() + entry.offset, size_t(entry.size), offset, temp);
+            entry.offset = offset;
+            offset += entry.size;
+            table.push_back(entry);
+        }
+        write_fully(fd, table.data(), table.size() * sizeof(GalleryEntry), offset, temp);
+
+        GalleryHeader header = header_;
+        header.table_offset = offset;
+        header.table_count = table.size();
+        write_fully(fd, &header, sizeof(GalleryHeader), 0, temp);
+        fsync(fd);
+    }
+    catch (...)
+    {
+        close(fd);
+        unlink(temp.c_str());
+        throw;
+    }
+    close(fd);
+    if (rename(temp.c_str(), name_.c_str()) != 0)
+    {
+        unlink(temp.c_str());
+        throw runtime_error("cannot replace " + name_ + ": " + strerror(errno));
+    }
+
+    // reopen the new file
+    close(fd_);
+    fd_ = open(name_.c_str(), O_RDWR);
+    if (fd_ < 0)
+    {
+        throw runtime_error("cannot open " + name_ + ": " + strerror(errno));
+    }
+    mapping_ = MappedFile(name_);
+    read_table();
+}
@@ -0,0 +1,151 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : gallery_io.cpp
+//   Description : memory mapped input and output files for SEAL objects
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gallery_io.h"
+
+using namespace std;
+
+namespace
+{
+    runtime_error io_error(const string &what, const string &name)
+    {
+        return runtime_error(what + " " + name + ": " + strerror(errno));
+    }
+}
+
+MappedFile::MappedFile(const string &name)
+{
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw io_error("cannot open", name);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw io_error("cannot stat", name);
+    }
+    size_ = size_t(info.st_size);
+
+    // an empty file cannot be mapped, loading from it fails in SEAL instead
+    if (size_ > 0)
+    {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data_ == MAP_FAILED)
+        {
+            data_ = nullptr;
+            close(fd);
+            throw io_error("cannot map", name);
+        }
+        // objects are deserialized front to back
+        madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : data_(exchange(other.data_, nullptr)), size_(exchange(other.size_, 0))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        data_ = exchange(other.data_, nullptr);
+        size_ = exchange(other.size_, 0);
+    }
+    return *this;
+}
+
+void MappedFile::unmap()
+{
+    if (data_)
+    {
+        munmap(data_, size_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+MappedOutputFile::MappedOutputFile(const string &name, size_t capacity)
+    : name_(name), capacity_(capacity)
+{
+    fd_ = open(name.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+    if (fd_ < 0)
+    {
+        throw io_error("cannot write", name);
+    }
+    if (ftruncate(fd_, off_t(capacity_)) != 0)
+    {
+        close(fd_);
+        throw io_error("cannot size", name);
+    }
+    data_ = mmap(nullptr, capacity_, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data_ == MAP_FAILED)
+    {
+        data_ = nullptr;
+        close(fd_);
+        throw io_error("cannot map", name);
+    }
+}
+
+MappedOutputFile::~MappedOutputFile()
+{
+    if (data_)
+    {
+        munmap(data_, capacity_);
+    }
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+void MappedOutputFile::finish(size_t size)
+{
+    munmap(data_, capacity_);
+    data_ = nullptr;
+
+    // save_size() is an upper bound, drop the unused tail
+    if (ftruncate(fd_, off_t(size)) != 0)
+    {
+        throw io_error("cannot truncate", name_);
+    }
+    close(fd_);
+    fd_ = -1;
+}
+
+size_t save_bytes_to_file(const vector<seal::seal_byte> &bytes, const string &name)
+{
+    MappedOutputFile file(name, bytes.size());
+    memcpy(file.data(), bytes.data(), bytes.size());
+    file.finish(bytes.size());
+    return bytes.size();
+}
@@ -0,0 +1,2425 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : match_engine.cpp
+//   Description : persistent matching engine shared by the enrollment and
+//                 authentication binaries, BFV and CKKS, 1:1 and 1:N
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+#include "seal/seal.h"
+#include "match_engine.h"
+#include "gallery_io.h"
+#include "gallery_container.h"
+#include "param_planner.h"
+#include "bounded_queue.h"
+
+using namespace std;
+using namespace seal;
+
+size_t next_power_of_two(size_t value)
+{
+    size_t power = 1;
+    while (power < value)
+    {
+        power *= 2;
+    }
+    return power;
+}
+
+sec_level_type to_sec_level(int security_level)
+{
+    switch (security_level)
+    {
+    case 128:
+        return sec_level_type::tc128;
+    case 192:
+        return sec_level_type::tc192;
+    case 256:
+        return sec_level_type::tc256;
+    default:
+        throw invalid_argument("security level must be 128, 192 or 256");
+    }
+}
+
+bool parse_scheme_mode(const string &scheme, const string &mode, scheme_type &parsed_scheme, MatchMode &parsed_mode)
+{
+    if ((scheme != "bfv" and scheme != "ckks") or (mode != "1-to-1" and mode != "1-to-n"))
+    {
+        return false;
+    }
+    parsed_scheme = (scheme == "ckks") ? scheme_type::ckks : scheme_type::bfv;
+    parsed_mode = (mode == "1-to-n") ? MatchMode::one_to_n : MatchMode::one_to_one;
+    return true;
+}
+
+MatchConfig default_config(scheme_type scheme, MatchMode mode, int security_level)
+{
+    MatchConfig config;
+    config.scheme = scheme;
+    config.mode = mode;
+    config.security_level = security_level;
+
+    // 1:1 CKKS probes are encoded at a smaller scale than the gallery
+    if (scheme == scheme_type::ckks and mode == MatchMode::one_to_one)
+    {
+        config.probe_scale = pow(2.0, 20);
+    }
+    return config;
+}
+
+EncryptionParameters make_parameters(const MatchConfig &config)
+{
+    sec_level_type sec_level = to_sec_level(config.security_level);
+    size_t poly_modulus_degree = (config.security_level == 128) ? 4096 : 8192;
+
+    // 1:N BFV packs one slot per gallery template
+    if (config.scheme == scheme_type::bfv and config.mode == MatchMode::one_to_n)
+    {
+        poly_modulus_degree = 32768;
+    }
+    if (config.poly_modulus_degree)
+    {
+        poly_modulus_degree = config.poly_modulus_degree;
+    }
+
+    EncryptionParameters parms(config.scheme);
+    if (config.scheme == scheme_type::bfv)
+    {
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        if (config.coeff_modulus_bits.empty())
+        {
+            parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree, sec_level));
+        }
+        else
+        {
+            parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, config.coeff_modulus_bits));
+        }
+        parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, config.plain_modulus_bits)); // seems like 16 also works
+    }
+    else if (config.scheme == scheme_type::ckks)
+    {
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        if (config.coeff_modulus_bits.empty())
+        {
+            parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, { 30, 20, 20, 30 }));
+        }
+        else
+        {
+            parms.set_coeff_modulus(CoeffModulus::Create(poly_modulus_degree, config.coeff_modulus_bits));
+        }
+    }
+    else
+    {
+        throw invalid_argument("unsupported scheme");
+    }
+    return parms;
+}
+
+void parse_options(int argc, char **argv, int first, MatchConfig &config)
+{
+    for (int i=first; i < argc; i++)
+    {
+        string option = argv[i];
+        if (option == "--workers" and i + 1 < argc)
+        {
+            config.num_workers = atoi(argv[++i]);
+        }
+        else if (option == "--packed")
+        {
+            config.layout = GalleryLayout::packed;
+        }
+        else if (option == "--replicated")
+        {
+            config.layout = GalleryLayout::replicated;
+        }
+        else if (option == "--packed-probe")
+        {
+            config.probe_format = ProbeFormat::packed;
+        }
+        else if (option == "--relin" and i + 1 < argc)
+        {
+            string policy = argv[++i];
+            if (policy == "eager")
+            {
+                config.relin_policy = RelinPolicy::eager;
+            }
+            else if (policy == "deferred")
+            {
+                config.relin_policy = RelinPolicy::deferred;
+            }
+            else if (policy == "none")
+            {
+                config.relin_policy = RelinPolicy::none;
+            }
+            else
+            {
+                throw invalid_argument("unknown relinearization policy " + policy);
+            }
+        }
+        else if (option == "--compact")
+        {
+            config.compact = true;
+        }
+        else if (option == "--compr" and i + 1 < argc)
+        {
+            string mode = argv[++i];
+            if (mode == "none")
+            {
+                config.compr_mode = compr_mode_type::none;
+            }
+            else if (mode == "zlib")
+            {
+                config.compr_mode = compr_mode_type::zlib;
+            }
+            else if (mode == "zstd")
+            {
+                config.compr_mode = compr_mode_type::zstd;
+            }
+            else
+            {
+                throw invalid_argument("unknown compression mode " + mode);
+            }
+            if (!Serialization::IsSupportedComprMode(config.compr_mode))
+            {
+                throw invalid_argument("SEAL was built without " + mode + " support");
+            }
+        }
+        else if (option == "--full-results")
+        {
+            config.switch_results = false;
+        }
+        else if (option == "--params" and i + 1 < argc)
+        {
+            load_plan(argv[++i], config);
+        }
+        else if (option == "--precision" and i + 1 < argc)
+        {
+            config.precision = float(atof(argv[++i]));
+        }
+        else if (option == "--noise")
+        {
+            config.track_noise = true;
+        }
+        else if (option == "--threshold" and i + 1 < argc)
+        {
+            config.threshold_decision = true;
+            config.threshold = float(atof(argv[++i]));
+        }
+        else if (option == "--threshold-iterations" and i + 1 < argc)
+        {
+            config.threshold_iterations = atoi(argv[++i]);
+        }
+        else if (option == "--rotation-base" and i + 1 < argc)
+        {
+            config.rotation_base = size_t(atoi(argv[++i]));
+        }
+        else if (option == "--resident")
+        {
+            config.resident = true;
+        }
+        else if (option == "--zero-pool" and i + 1 < argc)
+        {
+            config.zero_pool_depth = atoi(argv[++i]);
+        }
+        else if (option == "--zero-pool-threads" and i + 1 < argc)
+        {
+            config.zero_pool_threads = atoi(argv[++i]);
+        }
+        else if (option == "--cache-mb" and i + 1 < argc)
+        {
+            config.cache_bytes = size_t(atoll(argv[++i])) << 20;
+        }
+        else if (option == "--stream")
+        {
+            config.stream_gallery = true;
+        }
+        else if (option == "--prefetch-depth" and i + 1 < argc)
+        {
+            config.prefetch_depth = atoi(argv[++i]);
+        }
+        else if (option == "--prefetch-threads" and i + 1 < argc)
+        {
+            config.prefetch_threads = atoi(argv[++i]);
+        }
+        else if (option == "--batch-deadline" and i + 1 < argc)
+        {
+            config.batch_deadline_us = atoi(argv[++i]);
+        }
+        else if (option == "--max-batch" and i + 1 < argc)
+        {
+            config.max_batch = atoi(argv[++i]);
+        }
+        else if (option == "--connections" and i + 1 < argc)
+        {
+            config.connections = atoi(argv[++i]);
+        }
+        else if (option == "--append")
+        {
+            config.append = true;
+        }
+        else if (option == "--bulk")
+        {
+            config.bulk = true;
+        }
+        else if (option == "--checkpoint-every" and i + 1 < argc)
+        {
+            config.checkpoint_every = atoi(argv[++i]);
+        }
+        else if (option == "--revoke" and i + 1 < argc)
+        {
+            stringstream identities(argv[++i]);
+            string identity;
+            while (getline(identities, identity, ','))
+            {
+                config.revoke.push_back(size_t(stoull(identity)));
+            }
+        }
+        else if (option == "--replace" and i + 1 < argc)
+        {
+            config.replace_identity = atoi(argv[++i]);
+        }
+        else if (option == "--claim" and i + 1 < argc)
+        {
+            config.claimed_identity = atoi(argv[++i]);
+        }
+        else
+        {
+            throw invalid_argument("unknown option " + option);
+        }
+    }
+}
+
+vector<vector<float>> read_features(const string &name)
+{
+    ifstream ifile;
+    ifile.open(name.c_str(), ios::in|ios::binary);
+    if (ifile.fail())
+    {
+        throw runtime_error(name + " does not exist");
+    }
+
+    int num, dim;
+    ifile.read((char *)&num, sizeof(int));
+    ifile.read((char *)&dim, sizeof(int));
+
+    vector<vector<float>> features(num, vector<float>(dim));
+    for (int i=0; i < num; i++)
+    {
+        ifile.read((char *)features[i].data(), dim * sizeof(float));
+    }
+    ifile.close();
+    return features;
+}
+
+vector<vector<float>> read_features_transposed(const string &name)
+{
+    ifstream ifile;
+    ifile.open(name.c_str(), ios::in|ios::binary);
+    if (ifile.fail())
+    {
+        throw runtime_error(name + " does not exist");
+    }
+
+    int num, dim;
+    ifile.read((char *)&dim, sizeof(int));
+    ifile.read((char *)&num, sizeof(int));
+
+    vector<float> column(num);
+    vector<vector<float>> features(num, vector<float>(dim));
+    for (int i=0; i < dim; i++)
+    {
+        ifile.read((char *)column.data(), num * sizeof(float));
+        for (int j=0; j < num; j++)
+        {
+            features[j][i] = column[j];
+        }
+    }
+    ifile.close();
+    return features;
+}
+
+MatchEngine::Worker::Worker(const SEALContext &context)
+    : pool(MemoryPoolHandle::New()), evaluator(context)
+{
+}
+
+MatchEngine::MatchEngine(const MatchConfig &config)
+    : config_(config), parms_(make_parameters(config)), context_(parms_, true, to_sec_level(config.security_level))
+{
+    int num_workers = config_.num_workers;
+    if (num_workers <= 0)
+    {
+        num_workers = max(1, int(thread::hardware_concurrency()));
+    }
+    for (int i=0; i < num_workers; i++)
+    {
+        workers_.push_back(make_unique<Worker>(context_));
+    }
+    // the calling thread is worker 0, the pool runs the others
+    worker_pool_ = make_unique<WorkerPool>(workers_.size() - 1);
+
+    if (config_.verbose)
+    {
+        cout << "\nTotal memory allocated by global memory pool: "
+            << (MemoryPoolHandle::Global().alloc_byte_count() >> 20) << " MB" << endl;
+    }
+
+    if (config_.scheme == scheme_type::bfv)
+    {
+        batch_encoder_ = make_unique<BatchEncoder>(context_);
+    }
+    else
+    {
+        ckks_encoder_ = make_unique<CKKSEncoder>(context_);
+    }
+
+    if (config_.track_noise)
+    {
+        noise_tracker_ = make_unique<NoiseTracker>();
+    }
+
+    if (config_.stream_gallery and config_.cache_bytes > 0)
+    {
+        throw invalid_argument("a streamed gallery is not cached, use either --stream or --cache-mb");
+    }
+
+    if (config_.rotation_base < 2 or next_power_of_two(config_.rotation_base) != config_.rotation_base)
+    {
+        throw invalid_argument("the rotation base must be a power of two");
+    }
+
+    if (config_.threshold_decision and (!ckks_encoder_ or config_.threshold_iterations < 1))
+    {
+        throw invalid_argument("the threshold decision needs CKKS and at least one iteration");
+    }
+}
+
+size_t MatchEngine::slot_count() const
+{
+    return batch_encoder_ ? batch_encoder_->slot_count() : ckks_encoder_->slot_count();
+}
+
+size_t MatchEngine::segment_width() const
+{
+    // the rotation tree needs a power of two
+    return next_power_of_two(dim_);
+}
+
+size_t MatchEngine::templates_per_ciphertext() const
+{
+    if (config_.mode == MatchMode::one_to_one and config_.layout == GalleryLayout::packed)
+    {
+        // a segment never straddles the two BFV rows since it divides row_size
+        return slot_count() / segment_width();
+    }
+    return 1;
+}
+
+string MatchEngine::key_name(const string &kind) const
+{
+    string scheme = (config_.scheme == scheme_type::bfv) ? "bfv" : "ckks";
+    string mode = (config_.mode == MatchMode::one_to_one) ? "1_to_1" : "1_to_n";
+    return config_.key_dir + kind + "_" + scheme + "_" + mode + ".bin";
+}
+
+string MatchEngine::container_name() const
+{
+    string scheme = (config_.scheme == scheme_type::bfv) ? "bfv" : "ckks";
+    string mode = (config_.mode == MatchMode::one_to_one) ? "1_to_1" : "1_to_n";
+    if (config_.layout == GalleryLayout::packed)
+    {
+        mode += "_packed";
+    }
+    else if (config_.layout == GalleryLayout::replicated)
+    {
+        mode += "_replicated";
+    }
+    return config_.gallery_dir + "encrypted_gallery_" + scheme + "_" + mode + ".sfmg";
+}
+
+size_t MatchEngine::rotation_width(int dim) const
+{
+    // every rotation tree (1:1 scores, packed 1:1 segments, the packed 1:N
+    // probe expansion) sums the next power of two of dim slots of one row
+    size_t row_size = batch_encoder_ ? slot_count() / 2 : slot_count();
+    if (dim <= 0)
+    {
+        return row_size;
+    }
+    return min(row_size, next_power_of_two(size_t(dim)));
+}
+
+vector<int> MatchEngine::galois_steps(int dim) const
+{
+    vector<int> steps;
+    for (size_t step=1; step < rotation_width(dim); step *= config_.rotation_base)
+    {
+        steps.push_back(int(step));
+    }
+    return steps;
+}
+
+void MatchEngine::generate_keys(int dim)
+{
+    KeyGenerator keygen(context_);
+    secret_key_ = keygen.secret_key();
+    has_secret_key_ = true;
+    seeded_keys_.clear();
+    if (config_.compact)
+    {
+        // seeded keys store half of their polynomials as PRNG seeds, keep the
+        // serialized form for save_keys() and expand it for use here
+        seeded_keys_["public_key"] = save_to_buffer(keygen.create_public_key(), config_.compr_mode);
+        seeded_keys_["relin_key"] = save_to_buffer(keygen.create_relin_keys(), config_.compr_mode);
+        public_key_.load(context_, seeded_keys_["public_key"].data(), seeded_keys_["public_key"].size());
+        relin_key_.load(context_, seeded_keys_["relin_key"].data(), seeded_keys_["relin_key"].size());
+        if (uses_galois_keys())
+        {
+            seeded_keys_["galios_key"] = save_to_buffer(keygen.create_galois_keys(galois_steps(dim)), config_.compr_mode);
+            gal_key_.load(context_, seeded_keys_["galios_key"].data(), seeded_keys_["galios_key"].size());
+        }
+    }
+    else
+    {
+        keygen.create_public_key(public_key_);
+        keygen.create_relin_keys(relin_key_);
+        if (uses_galois_keys())
+        {
+            keygen.create_galois_keys(galois_steps(dim), gal_key_);
+        }
+    }
+
+    set_keys();
+}
+
+void MatchEngine::require_secret_key(const string &operation) const
+{
+    if (!has_secret_key_)
+    {
+        throw logic_error(operation + " needs the secret key, only the public keys were loaded");
+    }
+}
+
+void MatchEngine::set_keys()
+{
+    for (auto &worker : workers_)
+    {
+        worker->encryptor = make_unique<Encryptor>(context_, public_key_);
+        worker->decryptor.reset();
+        if (has_secret_key_)
+        {
+            worker->encryptor->set_secret_key(secret_key_);
+            worker->decryptor = make_unique<Decryptor>(context_, secret_key_);
+        }
+    }
+
+    // the pool starts encrypting zeros under the new public key right away
+    zero_pool_.reset();
+    if (config_.zero_pool_depth > 0)
+    {
+        zero_pool_ = make_unique<ZeroPool>(context_, public_key_, size_t(config_.zero_pool_depth), config_.zero_pool_threads);
+    }
+
+    // loaded keys may have been generated with any rotation base
+    key_steps_.clear();
+    if (uses_galois_keys())
+    {
+        auto galois_tool = context_.key_context_data()->galois_tool();
+        size_t row_size = batch_encoder_ ? slot_count() / 2 : slot_count();
+        for (size_t step=1; step < row_size; step *= 2)
+        {
+            if (gal_key_.has_key(galois_tool->get_elt_from_step(int(step))))
+            {
+                key_steps_.push_back(step);
+            }
+        }
+    }
+}
+
+void MatchEngine::encrypt(Worker &worker, const Plaintext &plain, Ciphertext &destination) const
+{
+    if (zero_pool_)
+    {
+        zero_pool_->encrypt(worker.evaluator, plain, destination, worker.pool);
+    }
+    else
+    {
+        worker.encryptor->encrypt(plain, destination, worker.pool);
+    }
+}
+
+void MatchEngine::parallel_for(size_t count, const function<void(size_t, size_t)> &body) const
+{
+    worker_pool_->run(count, body);
+}
+
+void MatchEngine::tree_reduce(vector<Ciphertext> &sums) const
+{
+    for (size_t stride=1; stride < sums.size(); stride *= 2)
+    {
+        size_t pairs = (sums.size() + 2 * stride - 1) / (2 * stride);
+        parallel_for(pairs, [&](size_t w, size_t i) {
+            size_t a = 2 * i * stride;
+            size_t b = a + stride;
+            if (b < sums.size())
+            {
+                workers_[w]->evaluator.add_inplace(sums[a], sums[b]);
+            }
+        });
+    }
+}
+
+size_t MatchEngine::replicas() const
+{
+    if (config_.layout != GalleryLayout::replicated or region_ == 0)
+    {
+        return 1;
+    }
+    return slot_count() / region_;
+}
+
+size_t MatchEngine::num_blocks() const
+{
+    if (config_.mode != MatchMode::one_to_n)
+    {
+        return 1;
+    }
+    return max(size_t(1), (size_t(num_gallery_) + slot_count() - 1) / slot_count());
+}
+
+void MatchEngine::rotate_sum(Worker &worker, Ciphertext &encrypted, size_t width) const
+{
+    Ciphertext temp;
+    for (size_t step=1; step < width; step *= 2)
+    {
+        rotate(worker, encrypted, step, temp);
+        worker.evaluator.add_inplace(encrypted, temp);
+    }
+}
+
+void MatchEngine::rotate(Worker &worker, const Ciphertext &encrypted, size_t step, Ciphertext &destination) const
+{
+    if (key_steps_.empty() or key_steps_[0] != 1)
+    {
+        throw logic_error("the Galois keys do not cover a rotation by 1");
+    }
+
+    // the largest key step below step divides it, since both are powers of two
+    size_t key_step = *(upper_bound(key_steps_.begin(), key_steps_.end(), step) - 1);
+    const Ciphertext *source = &encrypted;
+    for (size_t done=0; done < step; done += key_step)
+    {
+        if (batch_encoder_)
+        {
+            worker.evaluator.rotate_rows(*source, int(key_step), gal_key_, destination, worker.pool);
+        }
+        else
+        {
+            worker.evaluator.rotate_vector(*source, int(key_step), gal_key_, destination, worker.pool);
+        }
+        source = &destination;
+    }
+}
+
+void MatchEngine::prepare_layout()
+{
+    if (config_.layout == GalleryLayout::replicated)
+    {
+        if (config_.mode != MatchMode::one_to_n or config_.probe_format != ProbeFormat::broadcast)
+        {
+            throw invalid_argument("the replicated layout needs 1:N matching with broadcast probes");
+        }
+        if (region_ == 0 or region_ > slot_count())
+        {
+            throw invalid_argument("a replicated gallery must fit in " + to_string(slot_count()) + " slots");
+        }
+    }
+
+    // the 1:1 threshold decision keeps the slots that hold scores
+    if (config_.threshold_decision and config_.mode == MatchMode::one_to_one)
+    {
+        threshold_mask_.assign(slot_count(), 0.0);
+        for (size_t k=0; k < templates_per_ciphertext(); k++)
+        {
+            threshold_mask_[k * segment_width()] = 1.0;
+        }
+    }
+
+    if (config_.mode != MatchMode::one_to_one or config_.layout != GalleryLayout::packed)
+    {
+        return;
+    }
+    if (templates_per_ciphertext() == 0)
+    {
+        throw invalid_argument("dimension " + to_string(dim_) + " does not fit in " + to_string(slot_count()) + " slots");
+    }
+
+    // Only BFV masks the rotation garbage out of the non-leading slots of each
+    // segment. For CKKS the plaintext multiply would need a rescale and the
+    // default coefficient modulus has no level to spare after the product.
+    if (batch_encoder_)
+    {
+        vector<int64_t> pod_mask(slot_count(), 0);
+        for (size_t k=0; k < templates_per_ciphertext(); k++)
+        {
+            pod_mask[k * segment_width()] = 1;
+        }
+        batch_encoder_->encode(pod_mask, segment_mask_);
+
+        // the scores are still at the first level when they are masked,
+        // the evaluator then only transforms the ciphertext
+        if (config_.resident)
+        {
+            workers_[0]->evaluator.transform_to_ntt_inplace(segment_mask_, context_.first_parms_id(), workers_[0]->pool);
+        }
+    }
+}
+
+void MatchEngine::prepare_gallery()
+{
+    for (auto &encrypted_matrix : gallery_)
+    {
+        prepare_ciphertext(*workers_[0], encrypted_matrix);
+    }
+
+    // resident mode encodes the expansion masks for fresh packed probes once
+    expansion_masks_.clear();
+    if (config_.resident and config_.mode == MatchMode::one_to_n and config_.probe_format == ProbeFormat::packed)
+    {
+        expansion_masks_.resize(dim_);
+        parallel_for(dim_, [&](size_t w, size_t j) {
+            expansion_masks_[j] = expansion_mask(*workers_[w], j, context_.first_parms_id());
+            if (batch_encoder_)
+            {
+                workers_[w]->evaluator.transform_to_ntt_inplace(expansion_masks_[j], context_.first_parms_id(), workers_[w]->pool);
+            }
+        });
+    }
+}
+
+void MatchEngine::prepare_ciphertext(Worker &worker, Ciphertext &encrypted) const
+{
+    track(worker, "gallery", encrypted);
+
+    // a packed CKKS probe loses a level to its expansion
+    if (config_.mode == MatchMode::one_to_n and config_.probe_format == ProbeFormat::packed and ckks_encoder_)
+    {
+        worker.evaluator.mod_switch_to_next_inplace(encrypted, worker.pool);
+    }
+}
+
+size_t MatchEngine::gallery_ciphertexts() const
+{
+    if (config_.mode == MatchMode::one_to_one)
+    {
+        size_t per_ciphertext = templates_per_ciphertext();
+        return (size_t(num_gallery_) + per_ciphertext - 1) / per_ciphertext;
+    }
+    return num_blocks() * size_t(dim_);
+}
+
+shared_ptr<const Ciphertext> MatchEngine::cached_gallery(Worker &worker, uint64_t key, bool scan) const
+{
+    return gallery_cache_->get(key, [&](uint64_t missing) {
+        Ciphertext encrypted;
+        container_->load(context_, missing, encrypted);
+        prepare_ciphertext(worker, encrypted);
+        return encrypted;
+    }, scan);
+}
+
+void MatchEngine::scan_gallery(size_t count, const function<void(size_t, size_t, const Ciphertext &)> &body) const
+{
+    BoundedQueue<pair<size_t, Ciphertext>> queue(size_t(max(1, config_.prefetch_depth)));
+    exception_ptr error;
+    mutex error_mutex;
+    auto fail = [&]() {
+        {
+            lock_guard<mutex> lock(error_mutex);
+            if (!error)
+            {
+                error = current_exception();
+            }
+        }
+        queue.close();
+    };
+
+    // the readers take keys in order, the last one to finish closes the queue
+    atomic<size_t> next(0);
+    size_t num_readers = size_t(max(1, config_.prefetch_threads));
+    atomic<size_t> readers_left(num_readers);
+    vector<thread> readers;
+    for (size_t r=0; r < num_readers; r++)
+    {
+        readers.emplace_back([&]() {
+            try
+            {
+                for (size_t i = next++; i < count; i = next++)
+                {
+                    Ciphertext encrypted;
+                    container_->load(context_, uint64_t(i), encrypted);
+                    if (!queue.push(make_pair(i, move(encrypted))))
+                    {
+                        break;
+                    }
+                }
+            }
+            catch (...)
+            {
+                fail();
+            }
+            if (--readers_left == 0)
+            {
+                queue.close();
+            }
+        });
+    }
+
+    // the workers drain the queue, worker 0 on this thread; a worker leaves
+    // only once the queue is closed, so every worker takes one index
+    auto consume = [&](size_t w) {
+        try
+        {
+            pair<size_t, Ciphertext> item;
+            while (queue.pop(item))
+            {
+                prepare_ciphertext(*workers_[w], item.second);
+                body(w, item.first, item.second);
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+    };
+    parallel_for(min(workers_.size(), max(count, size_t(1))), [&](size_t w, size_t) {
+        consume(w);
+    });
+    for (auto &t : readers)
+    {
+        t.join();
+    }
+    if (error)
+    {
+        rethrow_exception(error);
+    }
+}
+
+Plaintext MatchEngine::expansion_mask(Worker &worker, size_t j, parms_id_type parms_id) const
+{
+    size_t segment = segment_width();
+    Plaintext mask;
+    if (batch_encoder_)
+    {
+        vector<int64_t> pod_mask(slot_count(), 0);
+        for (size_t i=j; i < pod_mask.size(); i += segment)
+        {
+            pod_mask[i] = 1;
+        }
+        batch_encoder_->encode(pod_mask, mask);
+    }
+    else
+    {
+        // encoding the mask at the scale of the prime dropped by the rescale
+        // gives the expanded probe back its original scale
+        vector<double> pod_mask(slot_count(), 0.0);
+        for (size_t i=j; i < pod_mask.size(); i += segment)
+        {
+            pod_mask[i] = 1.0;
+        }
+        auto context_data = context_.get_context_data(parms_id);
+        double mask_scale = double(context_data->parms().coeff_modulus().back().value());
+        ckks_encoder_->encode(pod_mask, parms_id, mask_scale, mask, worker.pool);
+    }
+    return mask;
+}
+
+Ciphertext MatchEngine::expand_probe(Worker &worker, const Ciphertext &packed, size_t j) const
+{
+    // keep the slots that hold dimension j, then sum each window of
+    // segment_width() slots, exactly one of which is non-zero
+    size_t segment = segment_width();
+    Ciphertext expanded;
+    if (!expansion_masks_.empty() and packed.parms_id() == context_.first_parms_id())
+    {
+        worker.evaluator.multiply_plain(packed, expansion_masks_[j], expanded, worker.pool);
+    }
+    else
+    {
+        worker.evaluator.multiply_plain(packed, expansion_mask(worker, j, packed.parms_id()), expanded, worker.pool);
+    }
+    if (ckks_encoder_)
+    {
+        worker.evaluator.rescale_to_next_inplace(expanded, worker.pool);
+    }
+    track(worker, "probe_mask", expanded);
+    rotate_sum(worker, expanded, segment);
+    track(worker, "probe_expand", expanded);
+    return expanded;
+}
+
+void MatchEngine::save_keys() const
+{
+    // create directory to save keys
+    filesystem::create_directories(config_.key_dir);
+
+    // seeded keys are written as generated, the others are serialized now
+    auto save_key = [&](const string &kind, const string &label, const auto &key) {
+        string name = key_name(kind);
+        if (config_.verbose) cout << "Saving " << label << ": " << name << endl;
+        auto seeded = seeded_keys_.find(kind);
+        size_t size = (seeded != seeded_keys_.end()) ? save_bytes_to_file(seeded->second, name) : save_to_file(key, name, config_.compr_mode);
+        if (config_.verbose) cout << "Size of " << label << ": " << size << " bytes" << endl;
+    };
+
+    // save the keys (public, secret, relin and galios)
+    save_key("public_key", "Public Key", public_key_);
+    save_key("secret_key", "Secret Key", secret_key_);
+    save_key("relin_key", "Relin Keys", relin_key_);
+    if (uses_galois_keys())
+    {
+        save_key("galios_key", "Galios Keys", gal_key_);
+    }
+}
+
+void MatchEngine::load_keys()
+{
+    load_key_files(true);
+}
+
+void MatchEngine::load_public_keys()
+{
+    // the budgets are measured by decrypting
+    if (config_.track_noise)
+    {
+        throw invalid_argument("--noise needs the secret key, which is not loaded here");
+    }
+    load_key_files(false);
+}
+
+void MatchEngine::load_key_files(bool with_secret_key)
+{
+    // load back the keys (public, secret, relin and galois)
+    string name = key_name("public_key");
+    if (config_.verbose) cout << "Loading Public Key: " << name << endl;
+    load_from_file(context_, public_key_, name, true);
+
+    has_secret_key_ = with_secret_key;
+    secret_key_ = SecretKey();
+    if (with_secret_key)
+    {
+        name = key_name("secret_key");
+        if (config_.verbose) cout << "Loading Private Key: " << name << endl;
+        load_from_file(context_, secret_key_, name, true);
+    }
+
+    if (uses_galois_keys())
+    {
+        name = key_name("galios_key");
+        if (config_.verbose) cout << "Loading Galios Keys: " << name << endl;
+        load_from_file(context_, gal_key_, name, true);
+    }
+
+    name = key_name("relin_key");
+    if (config_.verbose) cout << "Loading Relin Keys: " << name << endl;
+    load_from_file(context_, relin_key_, name, true);
+
+    set_keys();
+}
+
+Plaintext MatchEngine::encode(const vector<float> &values, size_t width, double scale) const
+{
+    // push values into a vector of size width, zero padded
+    Plaintext plain;
+    if (batch_encoder_)
+    {
+        vector<int64_t> pod_matrix(width, 0);
+        for (size_t j=0; j < values.size() and j < width; j++)
+        {
+            pod_matrix[j] = (int64_t) roundf(config_.precision*values[j]);
+        }
+        batch_encoder_->encode(pod_matrix, plain);
+    }
+    else
+    {
+        vector<double> pod_vector(width, 0.0);
+        for (size_t j=0; j < values.size() and j < width; j++)
+        {
+            pod_vector[j] = (double) values[j];
+        }
+        ckks_encoder_->encode(pod_vector, scale, plain);
+    }
+    return plain;
+}
+
+vector<float> MatchEngine::tile(const vector<float> &values, size_t segment) const
+{
+    vector<float> tiled(slot_count(), 0.0f);
+    for (size_t offset=0; offset + segment <= tiled.size(); offset += segment)
+    {
+        copy(values.begin(), values.begin() + min(values.size(), segment), tiled.begin() + offset);
+    }
+    return tiled;
+}
+
+Plaintext MatchEngine::encode_broadcast(float value, double scale) const
+{
+    // the same value in every slot
+    Plaintext plain;
+    if (batch_encoder_)
+    {
+        vector<int64_t> pod_vector(slot_count(), (int64_t) roundf(config_.precision*value));
+        batch_encoder_->encode(pod_vector, plain);
+    }
+    else
+    {
+        vector<double> pod_vector(slot_count(), (double) value);
+        ckks_encoder_->encode(pod_vector, scale, plain);
+    }
+    return plain;
+}
+
+GalleryHeader MatchEngine::gallery_header() const
+{
+    GalleryHeader header;
+    header.scheme = static_cast<uint8_t>(config_.scheme);
+    header.mode = static_cast<uint8_t>(config_.mode);
+    header.layout = static_cast<uint8_t>(config_.layout);
+    header.probe_format = static_cast<uint8_t>(config_.probe_format);
+    header.dim = uint32_t(dim_);
+    header.poly_modulus_degree = parms_.poly_modulus_degree();
+    header.parms_id = context_.first_parms_id();
+    header.num_templates = uint64_t(num_gallery_);
+    return header;
+}
+
+bool MatchEngine::matches_configuration(const GalleryHeader &header) const
+{
+    return header.scheme == static_cast<uint8_t>(config_.scheme) and header.mode == static_cast<uint8_t>(config_.mode)
+        and header.layout == static_cast<uint8_t>(config_.layout)
+        and header.poly_modulus_degree == parms_.poly_modulus_degree()
+        and header.parms_id == context_.first_parms_id();
+}
+
+void MatchEngine::enroll(const vector<vector<float>> &templates)
+{
+    if (templates.empty())
+    {
+        throw invalid_argument("no templates to enroll");
+    }
+    if (config_.compact)
+    {
+        require_secret_key("symmetric gallery encryption");
+    }
+    num_gallery_ = int(templates.size());
+    dim_ = int(templates[0].size());
+    region_ = templates.size();
+    free_slots_.clear();
+    gallery_.clear();
+    gallery_cache_.reset();
+    streamed_ = false;
+    prepare_layout();
+
+    // create directory to save encrypted gallery
+    filesystem::create_directories(config_.gallery_dir);
+    if (config_.bulk)
+    {
+        enroll_bulk(templates);
+        return;
+    }
+    string name = container_name();
+    if (config_.verbose) cout << "Saving Gallery: " << name << endl;
+    filesystem::remove(checkpoint_name());
+    GalleryContainer::create(name, gallery_header());
+    container_ = make_unique<GalleryContainer>(name, true);
+    size_t gallery_bytes = 0;
+
+    size_t count = gallery_ciphertexts();
+    size_t per_ciphertext = templates_per_ciphertext();
+    for (size_t key=0; key < count; key++)
+    {
+        if (config_.verbose)
+        {
+            if (config_.mode == MatchMode::one_to_n)
+            {
+                cout << "Encrypting Gallery Block " << key / dim_ << " Dim: " << key % dim_ << endl;
+            }
+            else if (config_.layout == GalleryLayout::packed)
+            {
+                cout << "Encrypting Gallery: " << key * per_ciphertext << " to "
+                    << min((key + 1) * per_ciphertext, size_t(num_gallery_)) - 1 << endl;
+            }
+            else
+            {
+                cout << "Encrypting Gallery: " << key << endl;
+            }
+        }
+        Ciphertext encrypted_matrix;
+        gallery_bytes += store_gallery(key, gallery_plaintext(templates, key), encrypted_matrix);
+        gallery_.push_back(encrypted_matrix);
+    }
+    container_->set_num_templates(uint64_t(num_gallery_));
+    container_->commit();
+    if (config_.verbose) cout << "Size of Gallery: " << gallery_.size() << " ciphertexts, " << gallery_bytes << " bytes" << endl;
+    prepare_gallery();
+}
+
+Plaintext MatchEngine::gallery_plaintext(const vector<vector<float>> &templates, size_t key) const
+{
+    if (config_.mode == MatchMode::one_to_one and config_.layout == GalleryLayout::packed)
+    {
+        // one template per segment, templates_per_ciphertext() per ciphertext
+        size_t segment = segment_width();
+        size_t per_ciphertext = templates_per_ciphertext();
+        vector<float> packed(slot_count(), 0.0f);
+        for (size_t k=0; k < per_ciphertext and key * per_ciphertext + k < templates.size(); k++)
+        {
+            const vector<float> &gallery = templates[key * per_ciphertext + k];
+            copy(gallery.begin(), gallery.end(), packed.begin() + k * segment);
+        }
+        return encode(packed, slot_count(), config_.gallery_scale);
+    }
+    if (config_.mode == MatchMode::one_to_one)
+    {
+        // push each template into the first row of the batching matrix (BFV)
+        // or into the whole slot vector (CKKS)
+        // actually we should be able to squeeze two gallery instances into one vector
+        // this depends on implementation, can get 2x speed up and 2x less storage
+        size_t width = batch_encoder_ ? slot_count() / 2 : slot_count();
+        return encode(templates[key], width, config_.gallery_scale);
+    }
+
+    // push dim i of every template of a block into a vector of size
+    // slot_count, galleries larger than slot_count are chunked into blocks
+    // stored as block * dim + i
+    size_t block = key / dim_;
+    size_t i = key % dim_;
+    size_t begin = block * slot_count();
+    size_t end = min(begin + slot_count(), templates.size());
+    vector<float> column(slot_count(), 0.0f);
+    for (size_t j=begin; j < end; j++)
+    {
+        column[j - begin] = templates[j][i];
+    }
+    for (size_t r=1; r < replicas(); r++)
+    {
+        copy(column.begin(), column.begin() + region_, column.begin() + r * region_);
+    }
+    return encode(column, slot_count(), config_.gallery_scale);
+}
+
+string MatchEngine::checkpoint_name() const
+{
+    return container_name() + ".progress";
+}
+
+bool MatchEngine::enrollment_interrupted() const
+{
+    return filesystem::exists(checkpoint_name());
+}
+
+void MatchEngine::enroll_bulk(const vector<vector<float>> &templates)
+{
+    // the checkpoint names the run (templates and dimension) and marks the
+    // container as incomplete, the journal next to it logs the entries of
+    // the ciphertexts that are done, so that a checkpoint writes only the
+    // new entries instead of a whole offset table. A resumed run skips
+    // those ciphertexts.
+    string name = container_name();
+    string checkpoint = checkpoint_name();
+    string journal = checkpoint + ".log";
+    size_t count = gallery_ciphertexts();
+    if (filesystem::exists(checkpoint) and filesystem::exists(name))
+    {
+        size_t num_templates = 0, dim = 0;
+        ifstream ifile(checkpoint);
+        ifile >> num_templates >> dim;
+        if (num_templates != size_t(num_gallery_) or dim != size_t(dim_))
+        {
+            throw runtime_error("checkpoint " + checkpoint + " is for " + to_string(num_templates)
+                + " templates of dimension " + to_string(dim) + ", remove it to start over");
+        }
+        container_ = make_unique<GalleryContainer>(name, true);
+        if (container_->header().parms_id != context_.first_parms_id())
+        {
+            throw runtime_error("gallery " + name + " was enrolled with different encryption parameters");
+        }
+        container_->recover(journal);
+        cout << "Resuming enrollment of " << name << " at " << container_->size() << " of " << count << " ciphertexts" << endl;
+    }
+    else
+    {
+        // the header counts no templates until the last ciphertext is in
+        if (config_.verbose) cout << "Saving Gallery: " << name << endl;
+        GalleryHeader header = gallery_header();
+        header.num_templates = 0;
+        GalleryContainer::create(name, header);
+        container_ = make_unique<GalleryContainer>(name, true);
+        filesystem::remove(journal);
+    }
+    auto save_checkpoint = [&](size_t done) {
+        {
+            ofstream ofile(checkpoint + ".tmp", ios::trunc);
+            ofile << num_gallery_ << " " << dim_ << " " << done << " " << count << endl;
+        }
+        filesystem::rename(checkpoint + ".tmp", checkpoint);
+    };
+
+    vector<size_t> pending;
+    for (size_t key=0; key < count; key++)
+    {
+        if (!container_->contains(key))
+        {
+            pending.push_back(key);
+        }
+    }
+    size_t done = count - pending.size();
+    save_checkpoint(done);
+
+    // the workers encode and encrypt, the writer appends the serialized
+    // ciphertexts in the order they are ready and journals every
+    // checkpoint_every of them
+    auto time_start = chrono::steady_clock::now();
+    auto rate = [&](size_t written) {
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+        return seconds > 0 ? double(written) * double(num_gallery_) / double(count) / seconds : 0.0;
+    };
+    BoundedQueue<pair<uint64_t, vector<seal_byte>>> queue(2 * workers_.size());
+    size_t written = 0;
+    size_t gallery_bytes = 0;
+    exception_ptr write_error;
+    thread writer([&]() {
+        try
+        {
+            pair<uint64_t, vector<seal_byte>> item;
+            while (queue.pop(item))
+            {
+                container_->append_bytes(item.first, item.second.data(), item.second.size());
+                gallery_bytes += item.second.size();
+                if (++written % size_t(max(1, config_.checkpoint_every)) == 0)
+                {
+                    container_->sync(journal);
+                    save_checkpoint(done + written);
+                    cout << "Enrolled " << done + written << " of " << count << " ciphertexts, "
+                        << rate(written) << " templates/s" << endl;
+                }
+            }
+        }
+        catch (...)
+        {
+            write_error = current_exception();
+            queue.close();
+        }
+    });
+
+    try
+    {
+        parallel_for(pending.size(), [&](size_t w, size_t n) {
+            Worker &worker = *workers_[w];
+            Plaintext plain_matrix = gallery_plaintext(templates, pending[n]);
+            vector<seal_byte> bytes;
+            if (config_.compact)
+            {
+                bytes = save_to_buffer(worker.encryptor->encrypt_symmetric(plain_matrix), config_.compr_mode);
+            }
+            else
+            {
+                Ciphertext encrypted_matrix;
+                worker.encryptor->encrypt(plain_matrix, encrypted_matrix, worker.pool);
+                bytes = save_to_buffer(encrypted_matrix, config_.compr_mode);
+            }
+            if (!queue.push(make_pair(uint64_t(pending[n]), move(bytes))))
+            {
+                throw runtime_error("the gallery writer stopped");
+            }
+        });
+    }
+    catch (...)
+    {
+        queue.close();
+        writer.join();
+        if (write_error)
+        {
+            rethrow_exception(write_error);
+        }
+        throw;
+    }
+    queue.close();
+    writer.join();
+    if (write_error)
+    {
+        rethrow_exception(write_error);
+    }
+
+    // complete, one table for the whole gallery; the payloads a crash left
+    // without a journal entry are dead and compacted away
+    container_->set_num_templates(uint64_t(num_gallery_));
+    container_->commit();
+    if (container_->dead_bytes() > 0)
+    {
+        container_->compact();
+    }
+    filesystem::remove(checkpoint);
+    filesystem::remove(journal);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+    cout << "Enrolled " << written << " ciphertexts (" << gallery_bytes << " bytes) in " << seconds << " s, "
+        << rate(written) << " templates/s" << endl;
+    open_gallery();
+}
+
+size_t MatchEngine::store_gallery(uint64_t key, const Plaintext &plain, Ciphertext &encrypted)
+{
+    if (config_.compact)
+    {
+        // a seeded symmetric ciphertext stores its second polynomial as the
+        // seed of the PRNG that generated it, roughly halving its size
+        vector<seal_byte> bytes = save_to_buffer(workers_[0]->encryptor->encrypt_symmetric(plain), config_.compr_mode);
+        container_->append_bytes(key, bytes.data(), bytes.size());
+        encrypted.load(context_, bytes.data(), bytes.size());
+        return bytes.size();
+    }
+    workers_[0]->encryptor->encrypt(plain, encrypted);
+    return container_->append(key, encrypted, config_.compr_mode);
+}
+
+void MatchEngine::open_for_update()
+{
+    if (config_.compact)
+    {
+        require_secret_key("symmetric gallery encryption");
+    }
+    if (!container_)
+    {
+        open_gallery();
+    }
+    if (config_.layout == GalleryLayout::replicated)
+    {
+        // the replicas are spaced by the gallery size
+        throw logic_error("a replicated 1:N gallery cannot be updated in place");
+    }
+
+    // reopen for writing, the resident ciphertexts (if any) are kept up to date
+    string name = container_name();
+    if (config_.verbose) cout << "Updating Gallery: " << name << endl;
+    container_ = make_unique<GalleryContainer>(name, true);
+}
+
+vector<size_t> MatchEngine::append(const vector<vector<float>> &templates)
+{
+    open_for_update();
+    vector<size_t> identities;
+    if (config_.mode == MatchMode::one_to_n)
+    {
+        // revoked slots first, then the slots past the enrolled count
+        size_t next = size_t(container_->header().num_templates);
+        auto free_slot = free_slots_.begin();
+        map<size_t, const vector<float> *> updates;
+        for (const auto &gallery : templates)
+        {
+            size_t identity = (free_slot != free_slots_.end()) ? *free_slot++ : next++;
+            updates[identity] = &gallery;
+            identities.push_back(identity);
+        }
+        update_columns(updates);
+        return identities;
+    }
+
+    size_t width = batch_encoder_ ? slot_count() / 2 : slot_count();
+    size_t per_ciphertext = templates_per_ciphertext();
+    size_t enrolled = size_t(container_->header().num_templates);
+    bool resident = size_t(num_gallery_) == enrolled and gallery_.size() == (enrolled + per_ciphertext - 1) / per_ciphertext;
+    Ciphertext encrypted_matrix;
+    for (size_t i=0; i < templates.size(); i++)
+    {
+        if (templates[i].size() != size_t(dim_))
+        {
+            throw invalid_argument("template and gallery dimensions do not match");
+        }
+        size_t identity = enrolled + i;
+        size_t key = identity / per_ciphertext;
+        size_t k = identity % per_ciphertext;
+        if (config_.verbose) cout << "Encrypting Gallery: " << identity << endl;
+
+        if (config_.layout == GalleryLayout::packed)
+        {
+            // encrypt the template in its segment and add it to the group,
+            // which is either the one built by the previous iteration or the
+            // partially filled last group of the enrolled gallery
+            vector<float> packed(slot_count(), 0.0f);
+            copy(templates[i].begin(), templates[i].end(), packed.begin() + k * segment_width());
+            Ciphertext encrypted_template;
+            workers_[0]->encryptor->encrypt(encode(packed, slot_count(), config_.gallery_scale), encrypted_template);
+            if (k == 0)
+            {
+                encrypted_matrix = encrypted_template;
+            }
+            else
+            {
+                if (i == 0)
+                {
+                    if (resident)
+                    {
+                        encrypted_matrix = gallery_[key];
+                    }
+                    else
+                    {
+                        container_->load(context_, key, encrypted_matrix);
+                    }
+                }
+                workers_[0]->evaluator.add_inplace(encrypted_matrix, encrypted_template);
+            }
+        }
+        else
+        {
+            store_gallery(key, encode(templates[i], width, config_.gallery_scale), encrypted_matrix);
+        }
+
+        // write each packed group once it is full, over the payload of the
+        // partially filled group when it fits
+        if (k + 1 == per_ciphertext or i + 1 == templates.size())
+        {
+            if (config_.layout == GalleryLayout::packed)
+            {
+                write_gallery(key, save_to_buffer(encrypted_matrix, config_.compr_mode));
+            }
+            if (resident and key < gallery_.size())
+            {
+                gallery_[key] = encrypted_matrix;
+            }
+            else if (resident)
+            {
+                gallery_.push_back(encrypted_matrix);
+            }
+        }
+    }
+    container_->set_num_templates(uint64_t(enrolled + templates.size()));
+    container_->commit();
+    if (gallery_cache_)
+    {
+        gallery_cache_->clear();
+    }
+
+    // a partially loaded gallery keeps its size
+    if (resident or gallery_.empty())
+    {
+        num_gallery_ = int(enrolled + templates.size());
+    }
+    for (size_t i=0; i < templates.size(); i++)
+    {
+        identities.push_back(enrolled + i);
+    }
+    return identities;
+}
+
+void MatchEngine::revoke(const vector<size_t> &identities)
+{
+    if (config_.mode != MatchMode::one_to_n)
+    {
+        throw logic_error("only 1:N galleries support revocation");
+    }
+    open_for_update();
+    map<size_t, const vector<float> *> updates;
+    for (size_t identity : identities)
+    {
+        if (identity >= container_->header().num_templates or free_slots_.count(identity))
+        {
+            throw invalid_argument("identity " + to_string(identity) + " is not enrolled");
+        }
+        updates[identity] = nullptr;
+    }
+    update_columns(updates);
+}
+
+void MatchEngine::replace(size_t identity, const vector<float> &gallery)
+{
+    if (config_.mode != MatchMode::one_to_n)
+    {
+        throw logic_error("only 1:N galleries support replacement");
+    }
+    open_for_update();
+    if (identity >= container_->header().num_templates or free_slots_.count(identity))
+    {
+        throw invalid_argument("identity " + to_string(identity) + " is not enrolled");
+    }
+    update_columns({ { identity, &gallery } });
+}
+
+void MatchEngine::write_gallery(uint64_t key, const vector<seal_byte> &bytes)
+{
+    // a ciphertext saved without compression has the same size every time
+    // and goes back into its slot, anything else is appended
+    if (!container_->replace_bytes(key, bytes.data(), bytes.size()))
+    {
+        container_->append_bytes(key, bytes.data(), bytes.size());
+    }
+}
+
+bool MatchEngine::budget_suffices(Worker &worker, const vector<Ciphertext> &columns) const
+{
+    // the column with the least budget stands for the block
+    size_t worst = 0;
+    int worst_budget = 0;
+    for (size_t i=0; i < columns.size(); i++)
+    {
+        int budget = worker.decryptor->invariant_noise_budget(columns[i]);
+        if (i == 0 or budget < worst_budget)
+        {
+            worst = i;
+            worst_budget = budget;
+        }
+    }
+    if (worst_budget <= 0)
+    {
+        throw runtime_error("a gallery block has no noise budget left, enroll it again");
+    }
+
+    // a match multiplies every column with a fresh probe, sums dim products
+    // and switch_result() drops the primes the score does not need, which
+    // leaves the budget short by as many bits
+    Plaintext ones;
+    batch_encoder_->encode(vector<int64_t>(slot_count(), int64_t(config_.precision)), ones);
+    Ciphertext product;
+    worker.encryptor->encrypt(ones, product, worker.pool);
+    worker.evaluator.multiply_inplace(product, columns[worst], worker.pool);
+    worker.evaluator.relinearize_inplace(product, relin_key_, worker.pool);
+    int budget = worker.decryptor->invariant_noise_budget(product) - int(ceil(log2(double(dim_))));
+    int dropped = 0;
+    if (config_.switch_results)
+    {
+        dropped = context_.get_context_data(product.parms_id())->total_coeff_modulus_bit_count()
+            - context_.get_context_data(result_level(product))->total_coeff_modulus_bit_count();
+    }
+    return budget - dropped >= result_margin_bits;
+}
+
+void MatchEngine::update_columns(const map<size_t, const vector<float> *> &updates)
+{
+    // every block touched gets one ciphertext per dimension holding the new
+    // templates in their slots and zeros elsewhere, added into the stored
+    // ciphertext of that block and dimension or becoming it for a new block.
+    // Only these ciphertexts are rewritten, O(dim) per block touched.
+    // the budget check and the CKKS subtraction decrypt
+    require_secret_key("updating a 1:N gallery");
+    size_t enrolled = size_t(container_->header().num_templates);
+    size_t stored_blocks = (enrolled + slot_count() - 1) / slot_count();
+    size_t total = enrolled;
+    for (const auto &update : updates)
+    {
+        if (update.second and update.second->size() != size_t(dim_))
+        {
+            throw invalid_argument("template and gallery dimensions do not match");
+        }
+        total = max(total, update.first + 1);
+    }
+    bool resident = size_t(num_gallery_) == enrolled and gallery_.size() == gallery_ciphertexts();
+
+    // the updates are sorted by slot, so blocks are visited in key order
+    auto update = updates.begin();
+    while (update != updates.end())
+    {
+        size_t block = update->first / slot_count();
+        size_t first = block * slot_count();
+        vector<pair<size_t, const vector<float> *>> changes;
+        vector<size_t> cleared;
+        for (; update != updates.end() and update->first < first + slot_count(); ++update)
+        {
+            size_t k = update->first - first;
+            if (update->first < enrolled and !free_slots_.count(update->first))
+            {
+                cleared.push_back(k);
+            }
+            if (update->second)
+            {
+                changes.emplace_back(k, update->second);
+            }
+        }
+
+        // a block with every slot cleared is encrypted anew, the product with
+        // an all-zero mask would be transparent
+        bool fresh = (block >= stored_blocks) or cleared.size() == slot_count();
+        Plaintext clear_mask;
+        if (!fresh and !cleared.empty() and batch_encoder_)
+        {
+            vector<int64_t> pod_mask(slot_count(), 1);
+            for (size_t k : cleared)
+            {
+                pod_mask[k] = 0;
+            }
+            batch_encoder_->encode(pod_mask, clear_mask);
+        }
+        if (config_.verbose) cout << "Updating Gallery Block " << block << ": " << changes.size() << " templates, "
+            << cleared.size() << " cleared" << endl;
+
+        // encrypt and add in parallel, then write in key order
+        vector<Ciphertext> columns(dim_);
+        vector<vector<seal_byte>> payloads(dim_);
+        parallel_for(dim_, [&](size_t w, size_t i) {
+            Worker &worker = *workers_[w];
+            vector<float> column(slot_count(), 0.0f);
+            for (const auto &change : changes)
+            {
+                column[change.first] = (*change.second)[i];
+            }
+
+            Ciphertext stored;
+            if (!fresh)
+            {
+                container_->load(context_, block * dim_ + i, stored);
+                if (batch_encoder_ and !cleared.empty())
+                {
+                    worker.evaluator.multiply_plain_inplace(stored, clear_mask, worker.pool);
+                    track(worker, "revoke", stored);
+                }
+                else if (!cleared.empty())
+                {
+                    // the CKKS product would need a rescale and leave the
+                    // ciphertext a level below the rest of the gallery
+                    vector<double> slots = decrypt_slots(worker, stored);
+                    for (size_t k : cleared)
+                    {
+                        column[k] -= float(slots[k]);
+                    }
+                }
+                if (all_of(column.begin(), column.end(), [](float value) { return value == 0.0f; }))
+                {
+                    columns[i] = move(stored);
+                    payloads[i] = save_to_buffer(columns[i], config_.compr_mode);
+                    return;
+                }
+            }
+
+            Plaintext plain_column = encode(column, slot_count(), config_.gallery_scale);
+            if (fresh and config_.compact)
+            {
+                payloads[i] = save_to_buffer(worker.encryptor->encrypt_symmetric(plain_column), config_.compr_mode);
+                columns[i].load(context_, payloads[i].data(), payloads[i].size());
+                return;
+            }
+            worker.encryptor->encrypt(plain_column, columns[i], worker.pool);
+            if (!fresh)
+            {
+                worker.evaluator.add_inplace(columns[i], stored);
+            }
+            payloads[i] = save_to_buffer(columns[i], config_.compr_mode);
+        });
+
+        // every mask and every added encryption eats into the noise budget
+        // of the block, it is encrypted again from its decrypted columns
+        // before a match could fail to decrypt
+        if (batch_encoder_ and !fresh and !budget_suffices(*workers_[0], columns))
+        {
+            if (config_.verbose) cout << "Re-encrypting Gallery Block " << block << endl;
+            parallel_for(dim_, [&](size_t w, size_t i) {
+                Worker &worker = *workers_[w];
+                Plaintext plain_column;
+                worker.decryptor->decrypt(columns[i], plain_column);
+                if (config_.compact)
+                {
+                    payloads[i] = save_to_buffer(worker.encryptor->encrypt_symmetric(plain_column), config_.compr_mode);
+                    columns[i].load(context_, payloads[i].data(), payloads[i].size());
+                    return;
+                }
+                worker.encryptor->encrypt(plain_column, columns[i], worker.pool);
+                payloads[i] = save_to_buffer(columns[i], config_.compr_mode);
+            });
+        }
+
+        for (size_t i=0; i < size_t(dim_); i++)
+        {
+            size_t key = block * dim_ + i;
+            write_gallery(key, payloads[i]);
+            if (resident)
+            {
+                prepare_ciphertext(*workers_[0], columns[i]);
+                if (key < gallery_.size())
+                {
+                    gallery_[key] = move(columns[i]);
+                }
+                else
+                {
+                    gallery_.push_back(move(columns[i]));
+                }
+            }
+        }
+    }
+
+    // the free-slot map replaces the previous one with the container table
+    for (const auto &change : updates)
+    {
+        if (change.second)
+        {
+            free_slots_.erase(change.first);
+        }
+        else
+        {
+            free_slots_.insert(change.first);
+        }
+    }
+    if (!free_slots_.empty() or container_->contains(free_slots_key))
+    {
+        vector<uint64_t> slots(free_slots_.begin(), free_slots_.end());
+        const seal_byte *bytes = reinterpret_cast<const seal_byte *>(slots.data());
+        write_gallery(free_slots_key, vector<seal_byte>(bytes, bytes + slots.size() * sizeof(uint64_t)));
+    }
+    container_->set_num_templates(uint64_t(total));
+    container_->commit();
+    if (gallery_cache_)
+    {
+        gallery_cache_->clear();
+    }
+    if (resident or gallery_.empty())
+    {
+        num_gallery_ = int(total);
+        region_ = total;
+    }
+}
+
+void MatchEngine::open_gallery()
+{
+    string name = container_name();
+    if (config_.verbose) cout << "Opening Gallery: " << name << endl;
+    if (enrollment_interrupted())
+    {
+        throw runtime_error("gallery " + name + " is incomplete, resume its bulk enrollment first");
+    }
+    container_ = make_unique<GalleryContainer>(name);
+
+    // the gallery must have been enrolled under the same configuration and keys
+    const GalleryHeader &header = container_->header();
+    if (!matches_configuration(header))
+    {
+        throw runtime_error("gallery " + name + " was enrolled with different encryption parameters");
+    }
+    num_gallery_ = int(header.num_templates);
+    dim_ = int(header.dim);
+    region_ = size_t(header.num_templates);
+    free_slots_.clear();
+    if (container_->contains(free_slots_key))
+    {
+        auto bytes = container_->payload(free_slots_key);
+        vector<uint64_t> slots(bytes.second / sizeof(uint64_t));
+        if (!slots.empty())
+        {
+            memcpy(slots.data(), bytes.first, slots.size() * sizeof(uint64_t));
+        }
+        free_slots_.insert(slots.begin(), slots.end());
+    }
+    gallery_.clear();
+    gallery_cache_.reset();
+    streamed_ = false;
+    prepare_layout();
+}
+
+void MatchEngine::use_layout(const GalleryHeader &header)
+{
+    if (!matches_configuration(header))
+    {
+        throw runtime_error("the gallery was enrolled with different encryption parameters");
+    }
+    if (config_.mode == MatchMode::one_to_n and header.probe_format != static_cast<uint8_t>(config_.probe_format))
+    {
+        throw runtime_error("the gallery is matched against probes of the other format, check --packed-probe");
+    }
+    num_gallery_ = int(header.num_templates);
+    dim_ = int(header.dim);
+    region_ = size_t(header.num_templates);
+    prepare_layout();
+}
+
+void MatchEngine::load_gallery()
+{
+    open_gallery();
+    load_gallery(num_gallery_, dim_);
+}
+
+void MatchEngine::load_gallery(int num_gallery, int dim)
+{
+    if (!container_)
+    {
+        open_gallery();
+    }
+    if (dim != dim_ or num_gallery > int(container_->header().num_templates))
+    {
+        throw invalid_argument("gallery holds " + to_string(container_->header().num_templates)
+            + " templates of dimension " + to_string(dim_));
+    }
+    num_gallery_ = num_gallery;
+    gallery_.clear();
+
+    // a streamed gallery is read by every match() instead, a cached one on
+    // demand
+    streamed_ = config_.stream_gallery;
+    if (streamed_)
+    {
+        if (config_.verbose) cout << "Streaming gallery from " << container_name() << endl;
+        prepare_gallery();
+        return;
+    }
+    if (config_.cache_bytes > 0)
+    {
+        if (config_.verbose) cout << "Caching up to " << (config_.cache_bytes >> 20) << " MB of gallery " << container_name() << endl;
+        gallery_cache_ = make_unique<GalleryCache>(config_.cache_bytes);
+        prepare_gallery();
+        return;
+    }
+
+    // 1:1 galleries have one ciphertext per template (or per group of packed
+    // templates), 1:N one per dimension of every block; the container streams
+    // them in key order
+    size_t count = gallery_ciphertexts();
+    if (config_.verbose) cout << "Loading gallery now " << endl;
+    gallery_.resize(count);
+    for (size_t i=0; i < count; i++)
+    {
+        container_->load(context_, uint64_t(i), gallery_[i]);
+    }
+    prepare_gallery();
+}
+
+EncryptedProbe MatchEngine::encrypt_probe(const vector<float> &probe) const
+{
+    EncryptedProbe encrypted_probe;
+    if (config_.mode == MatchMode::one_to_one)
+    {
+        Plaintext plain_probe;
+        if (config_.layout == GalleryLayout::packed)
+        {
+            // the probe is repeated in every segment
+            plain_probe = encode(tile(probe, next_power_of_two(probe.size())), slot_count(), config_.probe_scale);
+        }
+        else
+        {
+            size_t width = batch_encoder_ ? slot_count() / 2 : slot_count();
+            plain_probe = encode(probe, width, config_.probe_scale);
+        }
+        encrypted_probe.emplace_back();
+        encrypt(*workers_[0], plain_probe, encrypted_probe.back());
+    }
+    else if (config_.probe_format == ProbeFormat::packed)
+    {
+        // a single ciphertext, the server expands the dimensions
+        vector<float> tiled = tile(probe, next_power_of_two(probe.size()));
+        Plaintext plain_probe = encode(tiled, slot_count(), config_.packed_probe_scale);
+        encrypted_probe.emplace_back();
+        encrypt(*workers_[0], plain_probe, encrypted_probe.back());
+    }
+    else
+    {
+        // one broadcast ciphertext per dimension
+        encrypted_probe.resize(probe.size());
+        parallel_for(probe.size(), [&](size_t w, size_t j) {
+            Worker &worker = *workers_[w];
+            Plaintext plain_probe = encode_broadcast(probe[j], config_.probe_scale);
+            encrypt(worker, plain_probe, encrypted_probe[j]);
+        });
+    }
+    for (const auto &encrypted : encrypted_probe)
+    {
+        track(*workers_[0], "probe", encrypted);
+    }
+    return encrypted_probe;
+}
+
+size_t MatchEngine::max_probe_frame() const
+{
+    // fresh ciphertexts at the first level, serialized in the larger of the
+    // uncompressed and the default form
+    Ciphertext encrypted;
+    encrypted.resize(context_, context_.first_parms_id(), 2);
+    size_t ciphertext_size = size_t(max(encrypted.save_size(compr_mode_type::none),
+        encrypted.save_size(Serialization::compr_mode_default)));
+    return probe_ciphertexts() * (sizeof(uint64_t) + ciphertext_size);
+}
+
+size_t MatchEngine::probe_ciphertexts() const
+{
+    return (config_.mode == MatchMode::one_to_n and config_.probe_format == ProbeFormat::broadcast) ? size_t(dim_) : 1;
+}
+
+void MatchEngine::check_probe(const EncryptedProbe &probe) const
+{
+    if (probe.size() != probe_ciphertexts())
+    {
+        throw invalid_argument("a probe of " + to_string(probe.size()) + " ciphertexts, expected "
+            + to_string(probe_ciphertexts()));
+    }
+}
+
+Ciphertext MatchEngine::match_one(Worker &worker, const Ciphertext &probe, const Ciphertext &gallery) const
+{
+    // multiply with the gallery ciphertext and sum the slots by rotations,
+    // the score ends up in slot 0 (in the first slot of each segment when packed),
+    // the slots past dim are zero so the tree stops at the next power of two
+    size_t width = rotation_width(dim_);
+    bool packed = (config_.layout == GalleryLayout::packed);
+    Ciphertext encrypted_result;
+    worker.evaluator.multiply(probe, gallery, encrypted_result, worker.pool);
+    track(worker, "multiply", encrypted_result);
+    worker.evaluator.relinearize_inplace(encrypted_result, relin_key_, worker.pool);
+    track(worker, "relinearize", encrypted_result);
+    rotate_sum(worker, encrypted_result, width);
+    track(worker, "rotate_sum", encrypted_result);
+    if (packed and batch_encoder_)
+    {
+        worker.evaluator.multiply_plain_inplace(encrypted_result, segment_mask_, worker.pool);
+        track(worker, "segment_mask", encrypted_result);
+    }
+    if (config_.threshold_decision)
+    {
+        // the score is still at the product of the gallery and probe scales
+        worker.evaluator.rescale_to_next_inplace(encrypted_result, worker.pool);
+        apply_threshold(worker, encrypted_result, threshold_mask_);
+    }
+    switch_result(worker, encrypted_result);
+    track(worker, "result", encrypted_result);
+    return encrypted_result;
+}
+
+void MatchEngine::apply_threshold(Worker &worker, Ciphertext &encrypted, const vector<double> &mask) const
+{
+    // sign(x) is approximated by iterating f(x) = (3x - x^3) / 2 on
+    // x = (score - threshold) / 2, which lies in [-1, 1]. Each iteration
+    // costs two levels, the last one is folded with (1 + x) / 2 and the mask
+    // so that the result is 1 for a match, 0 for a non-match and 0 in the
+    // slots that hold no score.
+    size_t depth = 1 + 2 * size_t(config_.threshold_iterations);
+    size_t levels = context_.get_context_data(encrypted.parms_id())->chain_index();
+    if (levels < depth)
+    {
+        throw logic_error("the threshold decision needs " + to_string(depth) + " levels, the scores have "
+            + to_string(levels) + "; plan the parameters with --threshold");
+    }
+    if (encrypted.size() > 2)
+    {
+        worker.evaluator.relinearize_inplace(encrypted, relin_key_, worker.pool);
+    }
+
+    // Every ciphertext is kept at the scale of the last prime of its level,
+    // the one the next rescale divides by. The plaintext constants are
+    // encoded at whatever scale makes that exact. The decision itself ends
+    // at the gallery scale instead: at the bottom of a planned chain the
+    // last prime is the whole modulus and a value near half of it would
+    // wrap.
+    auto prime = [&](const Ciphertext &c, size_t down) {
+        auto context_data = context_.get_context_data(c.parms_id());
+        for (size_t i=0; i < down; i++)
+        {
+            context_data = context_data->next_context_data();
+        }
+        return double(context_data->parms().coeff_modulus().back().value());
+    };
+    auto constant = [&](const vector<double> &values, const Ciphertext &c, double scale) {
+        Plaintext plain;
+        ckks_encoder_->encode(values, c.parms_id(), scale, plain, worker.pool);
+        return plain;
+    };
+    auto uniform = [&](double value) {
+        return vector<double>(slot_count(), value);
+    };
+    Evaluator &evaluator = worker.evaluator;
+
+    // x = score / 2 - threshold / 2
+    Ciphertext x;
+    evaluator.multiply_plain(encrypted, constant(uniform(0.5), encrypted, prime(encrypted, 0) * prime(encrypted, 1) / encrypted.scale()), x, worker.pool);
+    evaluator.rescale_to_next_inplace(x, worker.pool);
+    evaluator.add_plain_inplace(x, constant(uniform(-0.5 * config_.threshold), x, x.scale()), worker.pool);
+
+    for (int i=0; i < config_.threshold_iterations; i++)
+    {
+        bool last = (i + 1 == config_.threshold_iterations);
+        vector<double> c1 = uniform(1.5);
+        vector<double> c3 = uniform(-0.5);
+        if (last)
+        {
+            for (size_t k=0; k < mask.size(); k++)
+            {
+                c1[k] = 0.75 * mask[k];
+                c3[k] = -0.25 * mask[k];
+            }
+        }
+        double q0 = prime(x, 0);
+        double q1 = prime(x, 1);
+        double target = last ? config_.gallery_scale : prime(x, 2);
+
+        // c3 x^3 at the target scale
+        Ciphertext square, cube, linear;
+        evaluator.square(x, square, worker.pool);
+        evaluator.relinearize_inplace(square, relin_key_, worker.pool);
+        evaluator.rescale_to_next_inplace(square, worker.pool);
+        evaluator.multiply_plain(x, constant(c3, x, target * q1 * q0 * q0 / (x.scale() * x.scale() * x.scale())), cube, worker.pool);
+        evaluator.rescale_to_next_inplace(cube, worker.pool);
+        evaluator.multiply_inplace(cube, square, worker.pool);
+        evaluator.relinearize_inplace(cube, relin_key_, worker.pool);
+        evaluator.rescale_to_next_inplace(cube, worker.pool);
+
+        // c1 x at the same level and scale
+        evaluator.multiply_plain(x, constant(c1, x, q1 * q0 / x.scale()), linear, worker.pool);
+        evaluator.rescale_to_next_inplace(linear, worker.pool);
+        evaluator.multiply_plain_inplace(linear, constant(uniform(1.0), linear, target), worker.pool);
+        evaluator.rescale_to_next_inplace(linear, worker.pool);
+
+        cube.scale() = linear.scale();
+        evaluator.add(cube, linear, x);
+    }
+    // the 1/2 of (1 + x) / 2 on the masked slots
+    vector<double> half(mask.size());
+    for (size_t k=0; k < mask.size(); k++)
+    {
+        half[k] = 0.5 * mask[k];
+    }
+    evaluator.add_plain_inplace(x, constant(half, x, x.scale()), worker.pool);
+    encrypted = move(x);
+}
+
+void MatchEngine::switch_result(Worker &worker, Ciphertext &encrypted) const
+{
+    if (!config_.switch_results)
+    {
+        return;
+    }
+    parms_id_type target = result_level(encrypted);
+    if (target != encrypted.parms_id())
+    {
+        worker.evaluator.mod_switch_to_inplace(encrypted, target, worker.pool);
+    }
+}
+
+parms_id_type MatchEngine::result_level(const Ciphertext &encrypted) const
+{
+    // Bits of coefficient modulus the score needs to decrypt correctly. For
+    // BFV the rounding noise of the switch is about t * sqrt(n) * |s| / q, so
+    // q must exceed t * sqrt(n) by a margin. CKKS switching drops primes
+    // exactly, q only has to hold the score at its scale.
+    double needed;
+    if (batch_encoder_)
+    {
+        needed = log2(double(parms_.plain_modulus().value())) + log2(double(parms_.poly_modulus_degree())) / 2 + result_margin_bits;
+    }
+    else
+    {
+        needed = log2(encrypted.scale()) + result_margin_bits;
+    }
+
+    // the lowest level of the chain that still has that many bits
+    auto context_data = context_.get_context_data(encrypted.parms_id());
+    parms_id_type target = encrypted.parms_id();
+    for (auto next = context_data->next_context_data(); next; next = next->next_context_data())
+    {
+        if (next->total_coeff_modulus_bit_count() < needed)
+        {
+            break;
+        }
+        target = next->parms_id();
+    }
+    return target;
+}
+
+void MatchEngine::track(Worker &worker, const char *stage, const Ciphertext &encrypted) const
+{
+    // CKKS has no invariant noise budget, its error is measured on the scores
+    if (noise_tracker_ and batch_encoder_ and worker.decryptor)
+    {
+        noise_tracker_->record_budget(stage, worker.decryptor->invariant_noise_budget(encrypted));
+    }
+}
+
+size_t MatchEngine::serialized_size(const EncryptedScores &scores) const
+{
+    size_t size = 0;
+    for (const auto &score : scores)
+    {
+        size += size_t(score.save_size(config_.compr_mode));
+    }
+    return size;
+}
+
+Ciphertext MatchEngine::verify(const EncryptedProbe &probe, int identity) const
+{
+    if (config_.mode != MatchMode::one_to_one)
+    {
+        throw logic_error("verification needs a 1:1 gallery");
+    }
+    if (identity < 0 or identity >= num_gallery_)
+    {
+        throw out_of_range("identity " + to_string(identity) + " is not enrolled");
+    }
+    check_probe(probe);
+
+    // use the resident ciphertext if the gallery is loaded, otherwise read
+    // just this one from the container
+    size_t key = size_t(identity) / templates_per_ciphertext();
+    if (gallery_cache_)
+    {
+        return match_one(*workers_[0], probe[0], *cached_gallery(*workers_[0], key, false));
+    }
+    if (key < gallery_.size())
+    {
+        return match_one(*workers_[0], probe[0], gallery_[key]);
+    }
+    if (!container_)
+    {
+        throw logic_error("gallery has not been opened");
+    }
+    Ciphertext gallery;
+    container_->load(context_, key, gallery);
+    return match_one(*workers_[0], probe[0], gallery);
+}
+
+EncryptedProbe MatchEngine::encrypt_probes(const vector<vector<float>> &probes) const
+{
+    if (config_.layout != GalleryLayout::replicated)
+    {
+        throw logic_error("batched probes need the replicated 1:N layout");
+    }
+    if (probes.empty() or probes.size() > probes_per_batch())
+    {
+        throw invalid_argument("a batch holds 1 to " + to_string(probes_per_batch()) + " probes");
+    }
+
+    // dimension j of probe p fills replica p of the broadcast of dimension j,
+    // the replicas of the batch that are not used stay zero
+    EncryptedProbe encrypted_probe(dim_);
+    parallel_for(dim_, [&](size_t w, size_t j) {
+        Worker &worker = *workers_[w];
+        vector<float> values(slot_count(), 0.0f);
+        for (size_t p=0; p < probes.size(); p++)
+        {
+            fill_n(values.begin() + p * region_, region_, probes[p][j]);
+        }
+        Plaintext plain_probe = encode(values, slot_count(), config_.probe_scale);
+        encrypt(worker, plain_probe, encrypted_probe[j]);
+    });
+    for (const auto &encrypted : encrypted_probe)
+    {
+        track(*workers_[0], "probe", encrypted);
+    }
+    return encrypted_probe;
+}
+
+vector<vector<float>> MatchEngine::decrypt_batch_scores(const EncryptedScores &scores, size_t num_probes) const
+{
+    vector<double> decoded = decrypt_slots(*workers_[0], scores[0]);
+    vector<vector<float>> result(num_probes);
+    for (size_t p=0; p < num_probes; p++)
+    {
+        for (size_t k=0; k < size_t(num_gallery_); k++)
+        {
+            result[p].push_back(float(decoded[p * region_ + k]));
+        }
+    }
+    return result;
+}
+
+EncryptedScores MatchEngine::match(const EncryptedProbe &probe) const
+{
+    return match_probes({ &probe })[0];
+}
+
+vector<EncryptedScores> MatchEngine::match_batch(const vector<EncryptedProbe> &probes) const
+{
+    vector<const EncryptedProbe *> pointers;
+    for (const auto &probe : probes)
+    {
+        pointers.push_back(&probe);
+    }
+    return match_probes(pointers);
+}
+
+vector<EncryptedScores> MatchEngine::match_probes(const vector<const EncryptedProbe *> &probes) const
+{
+    // every gallery ciphertext is read once per batch and multiplied with
+    // the probes of the batch one after another
+    size_t num_probes = probes.size();
+    vector<EncryptedScores> results(num_probes);
+    if (num_probes == 0)
+    {
+        return results;
+    }
+    for (const auto *probe : probes)
+    {
+        check_probe(*probe);
+    }
+    if (!streamed_ and !gallery_cache_ and gallery_.empty())
+    {
+        // only opened, or never loaded at all
+        throw logic_error("gallery has not been loaded");
+    }
+    if (config_.mode == MatchMode::one_to_one)
+    {
+        size_t count = (streamed_ or gallery_cache_) ? gallery_ciphertexts() : gallery_.size();
+        for (auto &scores : results)
+        {
+            scores.resize(count);
+        }
+        auto match_all = [&](size_t w, size_t j, const Ciphertext &gallery) {
+            for (size_t p=0; p < num_probes; p++)
+            {
+                results[p][j] = match_one(*workers_[w], (*probes[p])[0], gallery);
+            }
+        };
+        if (streamed_)
+        {
+            scan_gallery(count, match_all);
+        }
+        else if (gallery_cache_)
+        {
+            parallel_for(count, [&](size_t w, size_t j) {
+                match_all(w, j, *cached_gallery(*workers_[w], j, true));
+            });
+        }
+        else
+        {
+            parallel_for(count, [&](size_t w, size_t j) {
+                match_all(w, j, gallery_[j]);
+            });
+        }
+        return results;
+    }
+
+    // accumulate probe[j] * gallery[j] over the dimensions, slot k of the
+    // result of block b holds the score of gallery template b * slot_count() + k.
+    // The probe broadcasts are shared by every block. The dimensions are
+    // split into slices so that there are at least as many (block, slice)
+    // work items as workers, the partial sums of the slices of a block are
+    // then tree reduced. Unless the policy is eager the products stay at
+    // size 3 (and for CKKS at the product scale) and are relinearized and
+    // rescaled once per block.
+    bool packed = (config_.probe_format == ProbeFormat::packed);
+
+    vector<const EncryptedProbe *> broadcasts = probes;
+    vector<EncryptedProbe> expanded;
+    if (packed)
+    {
+        expanded.assign(num_probes, EncryptedProbe(dim_));
+        parallel_for(num_probes * dim_, [&](size_t w, size_t item) {
+            size_t p = item / dim_;
+            size_t j = item % dim_;
+            expanded[p][j] = expand_probe(*workers_[w], (*probes[p])[0], j);
+        });
+        for (size_t p=0; p < num_probes; p++)
+        {
+            broadcasts[p] = &expanded[p];
+        }
+    }
+
+    // adds probe[j] * gallery to a partial sum, empty until its first product
+    auto accumulate = [&](Worker &worker, size_t p, size_t j, const Ciphertext &gallery, Ciphertext &sum) {
+        Ciphertext temp;
+        worker.evaluator.multiply((*broadcasts[p])[j], gallery, temp, worker.pool);
+        track(worker, "multiply", temp);
+        if (config_.relin_policy == RelinPolicy::eager)
+        {
+            if (ckks_encoder_)
+            {
+                worker.evaluator.rescale_to_next_inplace(temp, worker.pool);
+            }
+            worker.evaluator.relinearize_inplace(temp, relin_key_, worker.pool);
+            track(worker, "relinearize", temp);
+        }
+        if (sum.size() == 0)
+        {
+            sum = move(temp);
+        }
+        else
+        {
+            worker.evaluator.add_inplace(sum, temp);
+        }
+    };
+
+    // relinearizes and rescales the sum of a block as the policy says and
+    // switches it to the result level
+    size_t blocks = num_blocks();
+    auto finish = [&](Worker &worker, size_t block, Ciphertext &scores) {
+        track(worker, "sum", scores);
+        if (config_.relin_policy != RelinPolicy::eager)
+        {
+            if (ckks_encoder_)
+            {
+                worker.evaluator.rescale_to_next_inplace(scores, worker.pool);
+            }
+            if (config_.relin_policy == RelinPolicy::deferred)
+            {
+                worker.evaluator.relinearize_inplace(scores, relin_key_, worker.pool);
+                track(worker, "relinearize", scores);
+            }
+        }
+        if (config_.threshold_decision)
+        {
+            // a bitmap of the templates of the block (of every replica)
+            vector<double> mask(slot_count(), 0.0);
+            for (size_t r=0; r < replicas(); r++)
+            {
+                fill_n(mask.begin() + r * region_, min(slot_count(), size_t(num_gallery_) - block * slot_count()), 1.0);
+            }
+            apply_threshold(worker, scores, mask);
+        }
+        switch_result(worker, scores);
+        track(worker, "result", scores);
+    };
+
+    for (auto &scores : results)
+    {
+        scores.resize(blocks);
+    }
+    if (streamed_)
+    {
+        // a streamed gallery arrives in key order, block after block, so only
+        // the blocks the queue and the workers are on have a sum in
+        // progress; the worker adding the last dimension of a block finishes
+        // it, and it holds its result only from then on
+        vector<mutex> block_mutex(blocks);
+        vector<size_t> arrived(blocks, 0);
+        scan_gallery(blocks * dim_, [&](size_t w, size_t i, const Ciphertext &encrypted) {
+            Worker &worker = *workers_[w];
+            size_t block = i / dim_;
+            vector<Ciphertext> products(num_probes);
+            for (size_t p=0; p < num_probes; p++)
+            {
+                accumulate(worker, p, i % dim_, encrypted, products[p]);
+            }
+            bool complete;
+            {
+                lock_guard<mutex> lock(block_mutex[block]);
+                for (size_t p=0; p < num_probes; p++)
+                {
+                    Ciphertext &sum = results[p][block];
+                    if (sum.size() == 0)
+                    {
+                        sum = move(products[p]);
+                    }
+                    else
+                    {
+                        worker.evaluator.add_inplace(sum, products[p]);
+                    }
+                }
+                complete = (++arrived[block] == size_t(dim_));
+            }
+            if (complete)
+            {
+                for (size_t p=0; p < num_probes; p++)
+                {
+                    finish(worker, block, results[p][block]);
+                }
+            }
+        });
+        return results;
+    }
+
+    // partial[p][block] holds the partial sums of probe p for a block
+    size_t slices = min(size_t(dim_), max(size_t(1), (workers_.size() + blocks - 1) / blocks));
+    vector<vector<vector<Ciphertext>>> partial(num_probes, vector<vector<Ciphertext>>(blocks, vector<Ciphertext>(slices)));
+    parallel_for(blocks * slices, [&](size_t w, size_t item) {
+        size_t block = item / slices;
+        size_t slice = item % slices;
+        size_t begin = slice * dim_ / slices;
+        size_t end = (slice + 1) * dim_ / slices;
+        for (size_t j=begin; j < end; j++)
+        {
+            size_t key = block * dim_ + j;
+            shared_ptr<const Ciphertext> cached;
+            if (gallery_cache_)
+            {
+                cached = cached_gallery(*workers_[w], key, true);
+            }
+            const Ciphertext &gallery = cached ? *cached : gallery_[key];
+            for (size_t p=0; p < num_probes; p++)
+            {
+                accumulate(*workers_[w], p, j, gallery, partial[p][block][slice]);
+            }
+        }
+    });
+
+    for (size_t p=0; p < num_probes; p++)
+    {
+        for (size_t block=0; block < blocks; block++)
+        {
+            tree_reduce(partial[p][block]);
+            results[p][block] = move(partial[p][block][0]);
+        }
+    }
+
+    parallel_for(num_probes * blocks, [&](size_t w, size_t item) {
+        size_t block = item % blocks;
+        finish(*workers_[w], block, results[item / blocks][block]);
+    });
+    return results;
+}
+
+vector<double> MatchEngine::decrypt_slots(Worker &worker, const Ciphertext &encrypted) const
+{
+    require_secret_key("decryption");
+    Plaintext plain_result;
+    worker.decryptor->decrypt(encrypted, plain_result);
+
+    vector<double> decoded;
+    if (batch_encoder_)
+    {
+        vector<int64_t> pod_result_quant;
+        batch_encoder_->decode(plain_result, pod_result_quant, worker.pool);
+        for (size_t k=0; k < pod_result_quant.size(); k++)
+        {
+            decoded.push_back(double(pod_result_quant[k]) / (config_.precision * config_.precision));
+        }
+    }
+    else
+    {
+        ckks_encoder_->decode(plain_result, decoded, worker.pool);
+    }
+    return decoded;
+}
+
+float MatchEngine::decrypt_score(const Ciphertext &score, int identity) const
+{
+    size_t k = size_t(identity) % templates_per_ciphertext();
+    return float(decrypt_slots(*workers_[0], score)[k * segment_width()]);
+}
+
+vector<float> MatchEngine::decrypt_scores(const EncryptedScores &scores) const
+{
+    vector<vector<double>> decoded(scores.size());
+    parallel_for(scores.size(), [&](size_t w, size_t i) {
+        decoded[i] = decrypt_slots(*workers_[w], scores[i]);
+    });
+
+    vector<float> result;
+    for (size_t i=0; i < decoded.size(); i++)
+    {
+        if (config_.mode == MatchMode::one_to_one)
+        {
+            size_t per_ciphertext = templates_per_ciphertext();
+            for (size_t k=0; k < per_ciphertext and i * per_ciphertext + k < size_t(num_gallery_); k++)
+            {
+                result.push_back(float(decoded[i][k * segment_width()]));
+            }
+        }
+        else
+        {
+            // result i holds gallery block i
+            for (size_t k=0; k < slot_count() and i * slot_count() + k < size_t(num_gallery_); k++)
+            {
+                result.push_back(float(decoded[i][k]));
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,233 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : match_protocol.cpp
+//   Description : message framing over Unix domain sockets
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "seal/seal.h"
+#include "match_protocol.h"
+#include "gallery_io.h"
+
+using namespace std;
+using namespace seal;
+
+namespace
+{
+    const char frame_magic[4] = { 'S', 'F', 'M', 'P' };
+
+    // a frame with more payloads than this is taken as a protocol error
+    const uint32_t max_payload_count = 1 << 20;
+
+    // payloads grow by at most this much per read
+    const size_t read_chunk = size_t(1) << 20;
+
+    void write_all(int fd, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw system_error(errno, generic_category(), "cannot write to socket");
+            }
+            bytes += written;
+            size -= size_t(written);
+        }
+    }
+
+    // returns false on end of stream before the first byte
+    bool read_all(int fd, void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        size_t done = 0;
+        while (done < size)
+        {
+            ssize_t got = ::recv(fd, bytes + done, size - done, 0);
+            if (got < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw system_error(errno, generic_category(), "cannot read from socket");
+            }
+            if (got == 0)
+            {
+                if (done == 0)
+                {
+                    return false;
+                }
+                throw runtime_error("connection closed in the middle of a message");
+            }
+            done += size_t(got);
+        }
+        return true;
+    }
+
+    void read_exact(int fd, void *data, size_t size)
+    {
+        if (!read_all(fd, data, size))
+        {
+            throw runtime_error("connection closed in the middle of a message");
+        }
+    }
+
+    sockaddr_un socket_address(const string &path)
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            throw invalid_argument("socket path " + path + " is too long");
+        }
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+        return address;
+    }
+}
+
+void send_message(int fd, const Message &message)
+{
+    // the header goes out in one write, the payloads as they are
+    uint32_t type = static_cast<uint32_t>(message.type);
+    uint32_t count = uint32_t(message.payloads.size());
+    char header[20];
+    memcpy(header, frame_magic, 4);
+    memcpy(header + 4, &type, 4);
+    memcpy(header + 8, &message.argument, 8);
+    memcpy(header + 16, &count, 4);
+    write_all(fd, header, sizeof(header));
+
+    for (const auto &payload : message.payloads)
+    {
+        uint64_t size = payload.size();
+        write_all(fd, &size, sizeof(size));
+        write_all(fd, payload.data(), payload.size());
+    }
+}
+
+bool receive_message(int fd, Message &message, uint64_t max_size)
+{
+    char magic[sizeof(frame_magic)];
+    if (!read_all(fd, magic, sizeof(magic)))
+    {
+        return false;
+    }
+    if (memcmp(magic, frame_magic, sizeof(frame_magic)) != 0)
+    {
+        throw runtime_error("not a face matching message");
+    }
+
+    uint32_t type;
+    uint32_t count;
+    read_exact(fd, &type, sizeof(type));
+    read_exact(fd, &message.argument, sizeof(message.argument));
+    read_exact(fd, &count, sizeof(count));
+    if (type < static_cast<uint32_t>(MessageType::match) or type > static_cast<uint32_t>(MessageType::layout)
+        or count > max_payload_count or uint64_t(count) * sizeof(uint64_t) > max_size)
+    {
+        throw runtime_error("malformed message header");
+    }
+    message.type = static_cast<MessageType>(type);
+
+    // the size fields are accounted for up front
+    uint64_t remaining = max_size - uint64_t(count) * sizeof(uint64_t);
+    message.payloads.assign(count, {});
+    for (auto &payload : message.payloads)
+    {
+        uint64_t size;
+        read_exact(fd, &size, sizeof(size));
+        if (size > remaining)
+        {
+            throw runtime_error("message of more than " + to_string(max_size) + " bytes");
+        }
+        remaining -= size;
+
+        // the size is only a claim, allocate as the bytes arrive
+        while (payload.size() < size)
+        {
+            size_t done = payload.size();
+            size_t chunk = size_t(min(size - done, uint64_t(read_chunk)));
+            payload.resize(done + chunk);
+            read_exact(fd, payload.data() + done, chunk);
+        }
+    }
+    return true;
+}
+
+vector<vector<seal_byte>> serialize_ciphertexts(const vector<Ciphertext> &ciphertexts, compr_mode_type compr_mode)
+{
+    vector<vector<seal_byte>> payloads;
+    for (const auto &encrypted : ciphertexts)
+    {
+        payloads.push_back(save_to_buffer(encrypted, compr_mode));
+    }
+    return payloads;
+}
+
+vector<Ciphertext> deserialize_ciphertexts(const SEALContext &context, const vector<vector<seal_byte>> &payloads)
+{
+    // load() checks every ciphertext against the parameters of context
+    vector<Ciphertext> ciphertexts(payloads.size());
+    for (size_t i=0; i < payloads.size(); i++)
+    {
+        ciphertexts[i].load(context, payloads[i].data(), payloads[i].size());
+    }
+    return ciphertexts;
+}
+
+int listen_unix(const string &path)
+{
+    sockaddr_un address = socket_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        throw system_error(errno, generic_category(), "cannot create socket");
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 or ::listen(fd, SOMAXCONN) < 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw system_error(error, generic_category(), "cannot listen on " + path);
+    }
+    return fd;
+}
+
+int connect_unix(const string &path)
+{
+    sockaddr_un address = socket_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        throw system_error(errno, generic_category(), "cannot create socket");
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw system_error(error, generic_category(), "cannot connect to " + path);
+    }
+    return fd;
+}
@@ -0,0 +1,150 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : noise_tracker.cpp
+//   Description : noise budget and score error bookkeeping
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "noise_tracker.h"
+
+using namespace std;
+
+vector<float> reference_scores(const vector<float> &probe, const vector<vector<float>> &gallery, float precision, bool quantize)
+{
+    auto value = [&](float x) {
+        return quantize ? double(roundf(precision * x)) / precision : double(x);
+    };
+
+    vector<float> scores;
+    for (const auto &feature : gallery)
+    {
+        if (feature.size() != probe.size())
+        {
+            throw invalid_argument("probe and gallery dimensions do not match");
+        }
+        double score = 0;
+        for (size_t j=0; j < probe.size(); j++)
+        {
+            score += value(probe[j]) * value(feature[j]);
+        }
+        scores.push_back(float(score));
+    }
+    return scores;
+}
+
+void NoiseTracker::record_budget(const string &stage, int budget)
+{
+    lock_guard<mutex> lock(mutex_);
+    auto found = budgets_.find(stage);
+    if (found == budgets_.end())
+    {
+        stages_.push_back(stage);
+        budgets_[stage] = { budget, budget, double(budget), 1 };
+        return;
+    }
+    BudgetStats &stats = found->second;
+    stats.min = min(stats.min, budget);
+    stats.max = max(stats.max, budget);
+    stats.sum += budget;
+    stats.count++;
+}
+
+void NoiseTracker::record_scores(const vector<float> &scores, const vector<float> &reference)
+{
+    lock_guard<mutex> lock(mutex_);
+    for (size_t i=0; i < scores.size() and i < reference.size(); i++)
+    {
+        double error = fabs(double(scores[i]) - double(reference[i]));
+        num_scores_++;
+        max_abs_error_ = max(max_abs_error_, error);
+        sum_abs_error_ += error;
+        sum_squared_error_ += error * error;
+
+        // relative errors of scores near zero say nothing
+        if (fabs(reference[i]) > 1e-2)
+        {
+            double rel_error = error / fabs(double(reference[i]));
+            max_rel_error_ = max(max_rel_error_, rel_error);
+            sum_rel_error_ += rel_error;
+            num_rel_++;
+        }
+    }
+}
+
+void NoiseTracker::record_decisions(const vector<float> &decisions, const vector<float> &reference, float threshold)
+{
+    lock_guard<mutex> lock(mutex_);
+    for (size_t i=0; i < decisions.size() and i < reference.size(); i++)
+    {
+        double expected = (reference[i] >= threshold) ? 1.0 : 0.0;
+        double error = fabs(double(decisions[i]) - expected);
+        num_decisions_++;
+        max_decision_error_ = max(max_decision_error_, error);
+        if (error >= 0.5)
+        {
+            wrong_decisions_++;
+        }
+    }
+}
+
+int NoiseTracker::min_budget() const
+{
+    lock_guard<mutex> lock(mutex_);
+    int budget = -1;
+    for (const auto &stage : budgets_)
+    {
+        budget = (budget < 0) ? stage.second.min : min(budget, stage.second.min);
+    }
+    return budget;
+}
+
+void NoiseTracker::print(ostream &stream) const
+{
+    int headroom = min_budget();
+    lock_guard<mutex> lock(mutex_);
+    if (!stages_.empty())
+    {
+        stream << "Noise budget (bits): stage, min, mean, max, count" << endl;
+        for (const auto &stage : stages_)
+        {
+            const BudgetStats &stats = budgets_.at(stage);
+            stream << "    " << setw(16) << left << stage << right << setw(6) << stats.min
+                << setw(8) << fixed << setprecision(1) << stats.sum / double(stats.count)
+                << setw(6) << stats.max << setw(10) << stats.count << endl;
+        }
+        stream << "Noise budget headroom: " << headroom << " bits" << endl;
+    }
+    if (num_scores_)
+    {
+        stream << scientific << setprecision(3);
+        stream << "Score error over " << num_scores_ << " scores: max abs " << max_abs_error_
+            << ", mean abs " << sum_abs_error_ / double(num_scores_)
+            << ", rms " << sqrt(sum_squared_error_ / double(num_scores_));
+        if (num_rel_)
+        {
+            stream << ", max rel " << max_rel_error_ << ", mean rel " << sum_rel_error_ / double(num_rel_);
+        }
+        stream << endl;
+        if (max_abs_error_ > 0)
+        {
+            stream << fixed << setprecision(1) << "Score precision: " << -log2(max_abs_error_) << " bits" << endl;
+        }
+        stream << defaultfloat;
+    }
+    if (num_decisions_)
+    {
+        stream << "Threshold decisions: " << num_decisions_ << ", wrong " << wrong_decisions_
+            << ", max distance from the reference bitmap " << fixed << setprecision(3) << max_decision_error_ << defaultfloat << endl;
+    }
+}
@@ -0,0 +1,327 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : param_planner.cpp
+//   Description : encryption parameter planner and parameter files
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "seal/seal.h"
+#include "param_planner.h"
+
+using namespace std;
+using namespace seal;
+
+namespace
+{
+    // bits of noise budget kept above the estimate
+    const int margin_bits = 8;
+
+    // bits the last level keeps above a switched score, see switch_result()
+    const int result_margin_bits = 10;
+
+    // largest prime CoeffModulus::Create can find
+    const int max_prime_bits = 60;
+
+    int ceil_log2(double value)
+    {
+        return int(ceil(log2(value)));
+    }
+
+    /*
+    Key switches of a rotation tree over width slots when only powers of base
+    have Galois keys, see MatchEngine::rotate().
+    */
+    double rotations(size_t width, size_t base)
+    {
+        double count = 0;
+        size_t key_step = 1;
+        for (size_t step=1; step < width; step *= 2)
+        {
+            while (key_step * base <= step)
+            {
+                key_step *= base;
+            }
+            count += double(step / key_step);
+        }
+        return count;
+    }
+
+    /*
+    Splits bits of data coefficient modulus into as few primes as possible,
+    the first one (the last level) at least first_bits, and appends the
+    special prime, which must be as large as the largest data prime.
+    */
+    vector<int> make_chain(int bits, int first_bits)
+    {
+        int count = max(1, (bits + max_prime_bits - 1) / max_prime_bits);
+        int each = (bits + count - 1) / count;
+        vector<int> chain(count, each);
+        chain[0] = max(each, first_bits);
+        chain.push_back(*max_element(chain.begin(), chain.end()));
+        return chain;
+    }
+
+    string scheme_name(scheme_type scheme)
+    {
+        return (scheme == scheme_type::bfv) ? "bfv" : "ckks";
+    }
+
+    string mode_name(MatchMode mode)
+    {
+        return (mode == MatchMode::one_to_one) ? "1_to_1" : "1_to_n";
+    }
+}
+
+ParameterPlan plan_parameters(const MatchConfig &config, int dim, int num_gallery)
+{
+    if (dim <= 0 or num_gallery <= 0)
+    {
+        throw invalid_argument("dimension and gallery size must be positive");
+    }
+    sec_level_type sec_level = to_sec_level(config.security_level);
+    bool bfv = (config.scheme == scheme_type::bfv);
+    bool one_to_one = (config.mode == MatchMode::one_to_one);
+    bool packed = one_to_one ? (config.layout == GalleryLayout::packed) : (config.probe_format == ProbeFormat::packed);
+    size_t segment = next_power_of_two(size_t(dim));
+
+    ParameterPlan best;
+    for (size_t n=1024; n <= 32768; n *= 2)
+    {
+        // every layout but the broadcast 1:N one keeps a template in one row
+        size_t row_size = n / 2;
+        if ((one_to_one or packed) and (packed ? segment : size_t(dim)) > row_size)
+        {
+            continue;
+        }
+
+        ParameterPlan plan;
+        plan.precision = config.precision;
+        plan.poly_modulus_degree = n;
+        double log_n = log2(double(n));
+        if (bfv)
+        {
+            // the plain modulus holds the signed inner product and is a
+            // batching prime, which needs a few bits above 2n
+            double bound = pow(config.precision + sqrt(double(dim)) / 2, 2);
+            plan.plain_modulus_bits = max(ceil_log2(2 * bound + 1) + 1, int(log_n) + 3);
+            int t = plan.plain_modulus_bits;
+
+            // plaintext room, fresh noise, the multiply and the plaintext masks;
+            // every level of the 1:1 rotation tree (over the next power of two of dim),
+            // of the 1:N dimension sum and of the probe expansion doubles the
+            // noise
+            size_t width = segment;
+            int masks = packed ? 1 : 0;
+            int sums = one_to_one ? ceil_log2(double(width)) : ceil_log2(double(dim)) + (packed ? ceil_log2(double(segment)) : 0);
+            int half_log_n = int(ceil(log_n / 2));
+            int bits = t + (half_log_n + 1) + (t + int(log_n)) + masks * (t + half_log_n) + sums + margin_bits;
+
+            // the last level has to hold a switched score
+            plan.coeff_modulus_bits = make_chain(bits, t + half_log_n + result_margin_bits);
+        }
+        else
+        {
+            // encoding error of about sqrt(n) per slot, summed over dim
+            int scale_bits = max(20, ceil_log2(config.precision) + 6 + int(ceil(log_n / 2 + log2(double(dim)) / 2)) + 4);
+            int first_bits = scale_bits + result_margin_bits;
+            plan.gallery_scale_bits = scale_bits;
+            plan.probe_scale_bits = scale_bits;
+            plan.packed_probe_scale_bits = scale_bits;
+            // the threshold decision rescales 1:1 scores once, then needs one
+            // level for its affine map and two per sign iteration
+            int threshold_levels = config.threshold_decision ? 1 + 2 * config.threshold_iterations : 0;
+            if (one_to_one and !config.threshold_decision)
+            {
+                // 1:1 scores stay at the product scale
+                plan.coeff_modulus_bits = make_chain(2 * scale_bits + result_margin_bits, 0);
+            }
+            else
+            {
+                // one rescale by the product, one more for the probe expansion
+                plan.coeff_modulus_bits = { first_bits, scale_bits };
+                if (packed and !one_to_one)
+                {
+                    plan.coeff_modulus_bits.push_back(scale_bits);
+                }
+                plan.coeff_modulus_bits.insert(plan.coeff_modulus_bits.end(), threshold_levels, scale_bits);
+                plan.coeff_modulus_bits.push_back(first_bits);
+            }
+        }
+
+        int total = 0;
+        for (int bits : plan.coeff_modulus_bits)
+        {
+            total += bits;
+        }
+        if (*max_element(plan.coeff_modulus_bits.begin(), plan.coeff_modulus_bits.end()) > max_prime_bits
+            or total > CoeffModulus::MaxBitCount(n, sec_level))
+        {
+            continue;
+        }
+
+        // cost of a probe in NTT sized operations on the data primes
+        size_t slots = bfv ? n : n / 2;
+        double ops;
+        if (one_to_one)
+        {
+            size_t per_ciphertext = packed ? slots / segment : 1;
+            plan.num_ciphertexts = (size_t(num_gallery) + per_ciphertext - 1) / per_ciphertext;
+            ops = double(plan.num_ciphertexts) * (2 + rotations(segment, config.rotation_base) + (packed and bfv ? 1 : 0));
+        }
+        else
+        {
+            size_t blocks = (size_t(num_gallery) + slots - 1) / slots;
+            plan.num_ciphertexts = blocks * size_t(dim);
+            ops = double(plan.num_ciphertexts) + (packed ? double(dim) * (1 + rotations(segment, config.rotation_base)) : 0.0);
+
+            // a replicated gallery scores slots / num_gallery probes per pass
+            if (config.layout == GalleryLayout::replicated)
+            {
+                if (blocks > 1)
+                {
+                    continue;
+                }
+                ops /= double(slots / size_t(num_gallery));
+            }
+        }
+        plan.cost = ops * double(n) * log_n * double(plan.coeff_modulus_bits.size() - 1);
+
+        if (best.poly_modulus_degree == 0 or plan.cost < best.cost)
+        {
+            best = plan;
+        }
+    }
+
+    if (best.poly_modulus_degree == 0)
+    {
+        throw invalid_argument("no parameters up to poly_modulus_degree 32768 fit dimension " + to_string(dim)
+            + " at " + to_string(config.security_level) + " bit security");
+    }
+    return best;
+}
+
+void apply_plan(const ParameterPlan &plan, MatchConfig &config)
+{
+    config.precision = plan.precision;
+    config.poly_modulus_degree = plan.poly_modulus_degree;
+    config.coeff_modulus_bits = plan.coeff_modulus_bits;
+    if (plan.plain_modulus_bits)
+    {
+        config.plain_modulus_bits = plan.plain_modulus_bits;
+    }
+    if (plan.gallery_scale_bits)
+    {
+        config.gallery_scale = pow(2.0, plan.gallery_scale_bits);
+        config.probe_scale = pow(2.0, plan.probe_scale_bits);
+        config.packed_probe_scale = pow(2.0, plan.packed_probe_scale_bits);
+    }
+}
+
+void save_plan(const ParameterPlan &plan, const MatchConfig &config, const string &name)
+{
+    ofstream ofile(name);
+    if (ofile.fail())
+    {
+        throw runtime_error("cannot write " + name);
+    }
+
+    ofile << "# encryption parameters written by the planner" << endl;
+    ofile << "scheme=" << scheme_name(config.scheme) << endl;
+    ofile << "mode=" << mode_name(config.mode) << endl;
+    ofile << "layout=" << (config.layout == GalleryLayout::packed ? "packed" : config.layout == GalleryLayout::replicated ? "replicated" : "standard") << endl;
+    ofile << "probe_format=" << (config.probe_format == ProbeFormat::packed ? "packed" : "broadcast") << endl;
+    ofile << "security_level=" << config.security_level << endl;
+    ofile << "precision=" << plan.precision << endl;
+    ofile << "poly_modulus_degree=" << plan.poly_modulus_degree << endl;
+    ofile << "coeff_modulus_bits=";
+    for (size_t i=0; i < plan.coeff_modulus_bits.size(); i++)
+    {
+        ofile << (i ? "," : "") << plan.coeff_modulus_bits[i];
+    }
+    ofile << endl;
+    ofile << "plain_modulus_bits=" << plan.plain_modulus_bits << endl;
+    ofile << "gallery_scale_bits=" << plan.gallery_scale_bits << endl;
+    ofile << "probe_scale_bits=" << plan.probe_scale_bits << endl;
+    ofile << "packed_probe_scale_bits=" << plan.packed_probe_scale_bits << endl;
+    ofile << "threshold_iterations=" << (config.threshold_decision ? config.threshold_iterations : 0) << endl;
+    ofile << "rotation_base=" << config.rotation_base << endl;
+}
+
+void load_plan(const string &name, MatchConfig &config)
+{
+    ifstream ifile(name);
+    if (ifile.fail())
+    {
+        throw runtime_error(name + " does not exist");
+    }
+
+    map<string, string> values;
+    string line;
+    while (getline(ifile, line))
+    {
+        line = line.substr(0, line.find('#'));
+        size_t split = line.find('=');
+        if (split != string::npos)
+        {
+            values[line.substr(0, split)] = line.substr(split + 1);
+        }
+    }
+    auto value = [&](const string &key) {
+        auto found = values.find(key);
+        if (found == values.end())
+        {
+            throw runtime_error(name + " has no " + key);
+        }
+        return found->second;
+    };
+
+    if (value("scheme") != scheme_name(config.scheme) or value("mode") != mode_name(config.mode)
+        or stoi(value("security_level")) != config.security_level)
+    {
+        throw invalid_argument(name + " was planned for " + value("scheme") + " " + value("mode")
+            + " at " + value("security_level") + " bit security");
+    }
+
+    ParameterPlan plan;
+    plan.precision = stof(value("precision"));
+    plan.poly_modulus_degree = stoul(value("poly_modulus_degree"));
+    stringstream chain(value("coeff_modulus_bits"));
+    string bits;
+    while (getline(chain, bits, ','))
+    {
+        plan.coeff_modulus_bits.push_back(stoi(bits));
+    }
+    plan.plain_modulus_bits = stoi(value("plain_modulus_bits"));
+    plan.gallery_scale_bits = stoi(value("gallery_scale_bits"));
+    plan.probe_scale_bits = stoi(value("probe_scale_bits"));
+    plan.packed_probe_scale_bits = stoi(value("packed_probe_scale_bits"));
+    apply_plan(plan, config);
+
+    config.layout = (value("layout") == "packed") ? GalleryLayout::packed
+        : (value("layout") == "replicated") ? GalleryLayout::replicated : GalleryLayout::standard;
+    config.probe_format = (value("probe_format") == "packed") ? ProbeFormat::packed : ProbeFormat::broadcast;
+
+    // levels were planned for this many sign iterations, --threshold T turns
+    // the decision on
+    if (values.count("threshold_iterations") and stoi(values["threshold_iterations"]) > 0)
+    {
+        config.threshold_iterations = stoi(values["threshold_iterations"]);
+    }
+    if (values.count("rotation_base"))
+    {
+        config.rotation_base = stoul(values["rotation_base"]);
+    }
+}
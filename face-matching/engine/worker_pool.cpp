@@ -0,0 +1,126 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : worker_pool.cpp
+//   Description : persistent threads of the matching engine
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#include "worker_pool.h"
+
+using namespace std;
+
+namespace
+{
+    // set while the thread runs a loop body, nested loops then run inline
+    thread_local bool in_loop = false;
+}
+
+WorkerPool::WorkerPool(size_t num_threads)
+{
+    for (size_t t=0; t < num_threads; t++)
+    {
+        threads_.emplace_back([this, t]() {
+            size_t w = t + 1;
+            size_t seen = 0;
+            unique_lock<mutex> lock(mutex_);
+            while (true)
+            {
+                start_.wait(lock, [&]() { return stopping_ or generation_ != seen; });
+                if (stopping_)
+                {
+                    return;
+                }
+                seen = generation_;
+                if (w > participants_)
+                {
+                    continue;
+                }
+                lock.unlock();
+                in_loop = true;
+                work(w);
+                in_loop = false;
+                lock.lock();
+                if (--active_ == 0)
+                {
+                    done_.notify_all();
+                }
+            }
+        });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    start_.notify_all();
+    for (auto &t : threads_)
+    {
+        t.join();
+    }
+}
+
+void WorkerPool::work(size_t w)
+{
+    try
+    {
+        for (size_t i = next_++; i < count_; i = next_++)
+        {
+            (*body_)(w, i);
+        }
+    }
+    catch (...)
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (!error_)
+        {
+            error_ = current_exception();
+        }
+    }
+}
+
+void WorkerPool::run(size_t count, const function<void(size_t, size_t)> &body)
+{
+    if (threads_.empty() or count <= 1 or in_loop)
+    {
+        for (size_t i=0; i < count; i++)
+        {
+            body(0, i);
+        }
+        return;
+    }
+
+    lock_guard<mutex> run_lock(run_mutex_);
+    {
+        lock_guard<mutex> lock(mutex_);
+        body_ = &body;
+        count_ = count;
+        next_ = 0;
+        error_ = nullptr;
+        participants_ = min(threads_.size(), count - 1);
+        active_ = participants_;
+        generation_++;
+    }
+    start_.notify_all();
+
+    in_loop = true;
+    work(0);
+    in_loop = false;
+
+    unique_lock<mutex> lock(mutex_);
+    done_.wait(lock, [&]() { return active_ == 0; });
+    body_ = nullptr;
+    if (error_)
+    {
+        exception_ptr error = error_;
+        error_ = nullptr;
+        rethrow_exception(error);
+    }
+}
@@ -0,0 +1,97 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : zero_pool.cpp
+//   Description : offline pool of fresh encryptions of zero
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "seal/seal.h"
+#include "zero_pool.h"
+
+using namespace std;
+using namespace seal;
+
+ZeroPool::ZeroPool(const SEALContext &context, const PublicKey &public_key, size_t capacity, int num_threads)
+    : encryptor_(context, public_key), queue_(capacity)
+{
+    for (int i=0; i < max(1, num_threads); i++)
+    {
+        threads_.emplace_back([this]() {
+            // each refill thread has its own memory pool
+            MemoryPoolHandle pool = MemoryPoolHandle::New();
+            while (true)
+            {
+                auto time_start = chrono::steady_clock::now();
+                Ciphertext zero;
+                encryptor_.encrypt_zero(zero, pool);
+                busy_ns_ += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - time_start).count();
+                if (!queue_.push(move(zero)))
+                {
+                    return;
+                }
+                produced_++;
+            }
+        });
+    }
+}
+
+ZeroPool::~ZeroPool()
+{
+    queue_.close();
+    for (auto &t : threads_)
+    {
+        t.join();
+    }
+}
+
+Ciphertext ZeroPool::take(MemoryPoolHandle pool)
+{
+    Ciphertext zero;
+    taken_++;
+    if (!queue_.try_pop(zero))
+    {
+        misses_++;
+        encryptor_.encrypt_zero(zero, pool);
+    }
+    return zero;
+}
+
+void ZeroPool::encrypt(const Evaluator &evaluator, const Plaintext &plain, Ciphertext &destination, MemoryPoolHandle pool)
+{
+    destination = take(pool);
+
+    // a CKKS encryption of zero carries no scale, it takes the one of plain
+    if (destination.is_ntt_form())
+    {
+        destination.scale() = plain.scale();
+    }
+    evaluator.add_plain_inplace(destination, plain, pool);
+}
+
+ZeroPoolStats ZeroPool::stats() const
+{
+    ZeroPoolStats stats;
+    stats.depth = queue_.size();
+    stats.capacity = queue_.capacity();
+    stats.produced = produced_;
+    stats.taken = taken_;
+    stats.misses = misses_;
+    stats.refill_rate = busy_ns_ ? double(produced_) * double(threads_.size()) * 1e9 / double(busy_ns_) : 0.0;
+    return stats;
+}
+
+void ZeroPool::print(ostream &stream) const
+{
+    ZeroPoolStats stats = this->stats();
+    stream << "Zero pool: depth " << stats.depth << " of " << stats.capacity
+        << ", produced " << stats.produced << ", taken " << stats.taken
+        << ", misses " << stats.misses
+        << ", refill rate " << fixed << setprecision(1) << stats.refill_rate << " per second" << endl;
+}
@@ -0,0 +1,79 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : planner.cpp
+//   Description : chooses encryption parameters for a scheme, matching mode,
+//                 security level, feature dimension, precision and gallery
+//                 size and writes the parameter file that enrollment and
+//                 authentication read with --params
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <vector>
+#include <string>
+
+#include "seal/seal.h"
+#include "utils.h"
+#include "match_engine.h"
+#include "param_planner.h"
+
+using namespace std;
+using namespace seal;
+
+int main(int argc, char **argv)
+{
+    if (argc < 7)
+    {
+        cout << "usage: " << argv[0] << " <bfv|ckks> <1-to-1|1-to-n> <security level> <dim> <num gallery> <parameter file>"
+            << " [--precision P] [--packed] [--packed-probe]" << endl;
+        return 1;
+    }
+
+    string scheme = argv[1];
+    string mode = argv[2];
+    int security_level = atoi(argv[3]);
+    int dim = atoi(argv[4]);
+    int num_gallery = atoi(argv[5]);
+    string name = argv[6];
+
+    scheme_type scheme_id;
+    MatchMode match_mode;
+    if (!parse_scheme_mode(scheme, mode, scheme_id, match_mode))
+    {
+        cout << "unknown scheme " << scheme << " or mode " << mode << ", expected bfv|ckks and 1-to-1|1-to-n" << endl;
+        return 1;
+    }
+    MatchConfig config = default_config(scheme_id, match_mode, security_level);
+    parse_options(argc, argv, 7, config);
+
+    ParameterPlan plan = plan_parameters(config, dim, num_gallery);
+
+    // check that SEAL accepts the plan before enrollment can pick it up
+    apply_plan(plan, config);
+    SEALContext context(make_parameters(config), true, to_sec_level(security_level));
+    if (!context.parameters_set())
+    {
+        cout << "SEAL rejected the plan: " << context.parameter_error_message() << endl;
+        return 1;
+    }
+    save_plan(plan, config, name);
+
+    print_line(__LINE__);
+    cout << "Planned encryption parameters" << endl;
+    print_parameters(context);
+    if (plan.plain_modulus_bits)
+    {
+        cout << "|   plain_modulus_bits: " << plan.plain_modulus_bits << endl;
+    }
+    if (plan.gallery_scale_bits)
+    {
+        cout << "|   scale: 2^" << plan.gallery_scale_bits << endl;
+    }
+    cout << "|   gallery ciphertexts: " << plan.num_ciphertexts << endl;
+    cout << "|   relative cost per probe: " << plan.cost << endl;
+    cout << "Saved to " << name << endl;
+    return 0;
+}
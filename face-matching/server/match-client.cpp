@@ -0,0 +1,187 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : match-client.cpp
+//   Description : client of the matching server, encrypts the probes, sends
+//                 them over a Unix domain socket and decrypts the scores,
+//                 reporting the latency of every request and the throughput
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "seal/seal.h"
+#include "utils.h"
+#include "match_engine.h"
+#include "match_protocol.h"
+
+using namespace std;
+using namespace seal;
+
+int main(int argc, char **argv)
+{
+    if (argc < 5)
+    {
+        cout << "usage: " << argv[0] << " <bfv|ckks> <1-to-1|1-to-n> <security level> <socket path> [options]" << endl;
+        return 1;
+    }
+
+    string scheme = argv[1];
+    string mode = argv[2];
+    int security_level = atoi(argv[3]);
+    string path = argv[4];
+
+    scheme_type scheme_id;
+    MatchMode match_mode;
+    if (!parse_scheme_mode(scheme, mode, scheme_id, match_mode))
+    {
+        cout << "unknown scheme " << scheme << " or mode " << mode << ", expected bfv|ckks and 1-to-1|1-to-n" << endl;
+        return 1;
+    }
+    MatchConfig config = default_config(scheme_id, match_mode, security_level);
+    parse_options(argc, argv, 5, config);
+
+    // the client holds the secret key, the server sends the layout of the
+    // scores, the gallery stays on the server
+    MatchEngine engine(config);
+    engine.load_keys();
+    {
+        int fd = connect_unix(path);
+        Message request, response;
+        request.type = MessageType::layout;
+        send_message(fd, request);
+        if (!receive_message(fd, response) or response.type != MessageType::layout
+            or response.payloads.size() != 1 or response.payloads[0].size() != sizeof(GalleryHeader))
+        {
+            cerr << "the server sent no gallery layout" << endl;
+            return 1;
+        }
+        ::close(fd);
+        GalleryHeader header;
+        memcpy(&header, response.payloads[0].data(), sizeof(header));
+        engine.use_layout(header);
+    }
+
+    vector<vector<float>> probes = read_features("../data/probe-1-to-1.bin");
+    int num_probe = int(probes.size());
+    bool verify = (config.claimed_identity >= 0);
+
+    // --connections N sends the probes over N connections at once, each
+    // one waits for its scores before sending its next probe
+    int num_connections = max(1, min(config.connections, num_probe));
+    vector<vector<float>> scores(num_probe);
+    vector<double> latency(num_probe);
+    vector<string> errors(num_connections);
+    auto run = [&](int c) {
+        try
+        {
+            int fd = connect_unix(path);
+            for (int i=c; i < num_probe; i += num_connections)
+            {
+                // the round trip includes encryption and decryption on this side
+                auto time_start = std::chrono::steady_clock::now();
+                Message request;
+                request.type = verify ? MessageType::verify : MessageType::match;
+                request.argument = config.claimed_identity;
+                request.payloads = serialize_ciphertexts(engine.encrypt_probe(probes[i]), config.compr_mode);
+                send_message(fd, request);
+
+                Message response;
+                if (!receive_message(fd, response))
+                {
+                    throw runtime_error("server closed the connection");
+                }
+                if (response.type == MessageType::error)
+                {
+                    const auto &text = response.payloads.at(0);
+                    throw runtime_error("server error: " + string(reinterpret_cast<const char *>(text.data()), text.size()));
+                }
+                EncryptedScores encrypted_scores = deserialize_ciphertexts(engine.context(), response.payloads);
+                if (verify)
+                {
+                    scores[i].push_back(engine.decrypt_score(encrypted_scores.at(0), config.claimed_identity));
+                }
+                else
+                {
+                    scores[i] = engine.decrypt_scores(encrypted_scores);
+                }
+                auto time_end = std::chrono::steady_clock::now();
+                latency[i] = std::chrono::duration<double, std::milli>(time_end - time_start).count();
+            }
+            ::close(fd);
+        }
+        catch (const exception &e)
+        {
+            errors[c] = e.what();
+        }
+    };
+
+    auto wall_start = std::chrono::steady_clock::now();
+    vector<thread> threads;
+    for (int c=1; c < num_connections; c++)
+    {
+        threads.emplace_back(run, c);
+    }
+    run(0);
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+    for (const auto &error : errors)
+    {
+        if (!error.empty())
+        {
+            cerr << error << endl;
+            return 1;
+        }
+    }
+
+    for (int i=0; i < num_probe; i++)
+    {
+        for (size_t j=0; j < scores[i].size(); j++)
+        {
+            int gallery = verify ? config.claimed_identity : int(j);
+            if (config.threshold_decision)
+            {
+                // the server returned encrypted 0/1 decisions, not scores
+                cout << "Match Decision (probe " << i << ", and gallery " << gallery << "): " << (scores[i][j] > 0.5f) << endl;
+            }
+            else
+            {
+                cout << "Matching Score (probe " << i << ", and gallery " << gallery << "): " << scores[i][j] << endl;
+            }
+        }
+        cout << " " << endl;
+    }
+
+    if (!latency.empty())
+    {
+        double total = 0;
+        for (double value : latency)
+        {
+            total += value;
+        }
+        sort(latency.begin(), latency.end());
+        auto percentile = [&](double p) {
+            return latency[min(latency.size() - 1, size_t(p * double(latency.size())))];
+        };
+        cout << "Requests: " << latency.size() << endl;
+        cout << "Avg latency per request (ms): " << total / double(latency.size()) << endl;
+        cout << "p50 / p99 latency (ms): " << percentile(0.50) << " / " << percentile(0.99) << endl;
+        cout << "Throughput (probes/s): " << double(num_probe) * 1000.0 / wall_ms << endl;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
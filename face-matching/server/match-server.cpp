@@ -0,0 +1,248 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : match-server.cpp
+//   Description : long running matching server, loads the keys and the
+//                 encrypted gallery once and matches encrypted probes sent
+//                 over a Unix domain socket, answering with encrypted scores
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <set>
+#include <memory>
+#include <csignal>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "seal/seal.h"
+#include "utils.h"
+#include "match_engine.h"
+#include "match_protocol.h"
+#include "batch_scheduler.h"
+
+using namespace std;
+using namespace seal;
+
+namespace
+{
+    atomic<bool> stopping(false);
+
+    void on_signal(int)
+    {
+        stopping = true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 5)
+    {
+        cout << "usage: " << argv[0] << " <bfv|ckks> <1-to-1|1-to-n> <security level> <socket path> [options]" << endl;
+        return 1;
+    }
+
+    string scheme = argv[1];
+    string mode = argv[2];
+    int security_level = atoi(argv[3]);
+    string path = argv[4];
+
+    scheme_type scheme_id;
+    MatchMode match_mode;
+    if (!parse_scheme_mode(scheme, mode, scheme_id, match_mode))
+    {
+        cout << "unknown scheme " << scheme << " or mode " << mode << ", expected bfv|ckks and 1-to-1|1-to-n" << endl;
+        return 1;
+    }
+    MatchConfig config = default_config(scheme_id, match_mode, security_level);
+    parse_options(argc, argv, 5, config);
+
+    // the context, keys and gallery are set up once for every request; the
+    // server never sees the secret key, it only returns encrypted scores
+    MatchEngine engine(config);
+    print_line(__LINE__);
+    cout << "Set encryption parameters and print" << endl;
+    print_parameters(engine.context());
+    engine.load_public_keys();
+    engine.load_gallery();
+
+    // requests are probes, anything larger is dropped unread
+    size_t max_request = engine.max_probe_frame();
+
+    int listen_fd = listen_unix(path);
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    cout << "Serving " << engine.num_gallery() << " templates on " << path << endl;
+
+    // connections are read and answered on their own threads, the engine
+    // matches one probe at a time with all of its workers, or with
+    // --batch-deadline the scheduler matches the probes of concurrent
+    // requests in one read of a streamed or cached gallery
+    unique_ptr<BatchScheduler> scheduler;
+    if (config.batch_deadline_us > 0)
+    {
+        if (!config.stream_gallery and config.cache_bytes == 0)
+        {
+            cerr << "--batch-deadline only shares the reads of a --stream or --cache-mb gallery" << endl;
+            return 1;
+        }
+        scheduler = make_unique<BatchScheduler>(engine, size_t(config.max_batch), std::chrono::microseconds(config.batch_deadline_us));
+    }
+    mutex match_mutex;
+    mutex stats_mutex;
+    size_t num_requests = 0;
+    double time_total = 0;
+
+    // open connections, shut down on exit to wake up the threads waiting
+    // for a request
+    mutex connections_mutex;
+    condition_variable connections_done;
+    set<int> connections;
+
+    auto serve = [&](int fd) {
+        try
+        {
+            Message request;
+            while (receive_message(fd, request, max_request))
+            {
+                Message response;
+                if (request.type == MessageType::layout)
+                {
+                    GalleryHeader header = engine.gallery_header();
+                    const seal_byte *bytes = reinterpret_cast<const seal_byte *>(&header);
+                    response.type = MessageType::layout;
+                    response.payloads.assign(1, vector<seal_byte>(bytes, bytes + sizeof(header)));
+                    send_message(fd, response);
+                    continue;
+                }
+                try
+                {
+                    // a malformed probe is rejected before it can join a batch
+                    EncryptedProbe probe = deserialize_ciphertexts(engine.context(), request.payloads);
+                    engine.check_probe(probe);
+                    if (request.type == MessageType::verify
+                        and (request.argument < 0 or request.argument > numeric_limits<int>::max()))
+                    {
+                        throw invalid_argument("identity " + to_string(request.argument) + " is not enrolled");
+                    }
+                    EncryptedScores scores;
+                    std::chrono::steady_clock::time_point time_start, time_end;
+                    if (scheduler and request.type == MessageType::match)
+                    {
+                        // the time includes the wait for the batch to close
+                        time_start = std::chrono::steady_clock::now();
+                        scores = scheduler->match(move(probe));
+                        time_end = std::chrono::steady_clock::now();
+                    }
+                    else if (scheduler and request.type == MessageType::verify)
+                    {
+                        // not while the scheduler matches a batch
+                        time_start = std::chrono::steady_clock::now();
+                        scores.push_back(scheduler->verify(probe, int(request.argument)));
+                        time_end = std::chrono::steady_clock::now();
+                    }
+                    else
+                    {
+                        lock_guard<mutex> lock(match_mutex);
+                        time_start = std::chrono::steady_clock::now();
+                        if (request.type == MessageType::match)
+                        {
+                            scores = engine.match(probe);
+                        }
+                        else if (request.type == MessageType::verify)
+                        {
+                            scores.push_back(engine.verify(probe, int(request.argument)));
+                        }
+                        else
+                        {
+                            throw invalid_argument("expected a match or verify request");
+                        }
+                        time_end = std::chrono::steady_clock::now();
+                    }
+                    response.type = MessageType::scores;
+                    response.payloads = serialize_ciphertexts(scores, config.compr_mode);
+
+                    lock_guard<mutex> lock(stats_mutex);
+                    num_requests++;
+                    time_total += std::chrono::duration<double, std::milli>(time_end - time_start).count();
+                }
+                catch (const exception &e)
+                {
+                    string text = e.what();
+                    response.type = MessageType::error;
+                    response.payloads.assign(1, vector<seal_byte>(
+                        reinterpret_cast<const seal_byte *>(text.data()), reinterpret_cast<const seal_byte *>(text.data()) + text.size()));
+                }
+                send_message(fd, response);
+            }
+        }
+        catch (const exception &e)
+        {
+            if (!stopping)
+            {
+                cerr << "Connection dropped: " << e.what() << endl;
+            }
+        }
+        lock_guard<mutex> lock(connections_mutex);
+        connections.erase(fd);
+        ::close(fd);
+        connections_done.notify_all();
+    };
+
+    while (!stopping)
+    {
+        pollfd listener = { listen_fd, POLLIN, 0 };
+        if (::poll(&listener, 1, 200) <= 0)
+        {
+            continue;
+        }
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+        lock_guard<mutex> lock(connections_mutex);
+        connections.insert(fd);
+        thread(serve, fd).detach();
+    }
+
+    {
+        unique_lock<mutex> lock(connections_mutex);
+        for (int fd : connections)
+        {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+        connections_done.wait(lock, [&]() { return connections.empty(); });
+    }
+    ::close(listen_fd);
+    ::unlink(path.c_str());
+
+    if (scheduler)
+    {
+        scheduler->print(cout);
+        scheduler.reset();
+    }
+    cout << "Requests served: " << num_requests << endl;
+    if (num_requests)
+    {
+        cout << "Avg time per request (ms): " << time_total / double(num_requests) << endl;
+    }
+    if (engine.gallery_cache())
+    {
+        engine.gallery_cache()->print(cout);
+    }
+    cout << "Done" << endl;
+    return 0;
+}
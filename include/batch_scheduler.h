@@ -0,0 +1,98 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : batch_scheduler.h
+//   Description : micro-batching scheduler in front of the matching engine,
+//                 coalesces probes that arrive within a latency deadline into
+//                 one pass over the gallery and hands every caller its scores
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <ostream>
+#include <thread>
+
+#include "match_engine.h"
+
+struct BatchSchedulerStats
+{
+    std::size_t requests = 0;
+    std::size_t batches = 0;
+    std::size_t max_batch = 0;
+
+    // time the requests waited for their batch to close, in milliseconds
+    double mean_wait_ms = 0;
+    double max_wait_ms = 0;
+};
+
+/*
+A batch closes when it holds max_batch probes or when its first probe has
+waited deadline, whichever comes first, and is matched with
+MatchEngine::match_batch on the scheduler thread while the next one fills.
+A probe waits at most deadline plus the time of the batch before it, and
+under load every pass over the gallery serves up to max_batch probes. The
+evaluations are the same as for single probes, only the reads of a streamed
+or cached gallery are shared, so the scheduler is meant for those.
+*/
+class BatchScheduler
+{
+public:
+    BatchScheduler(const MatchEngine &engine, std::size_t max_batch, std::chrono::microseconds deadline);
+
+    ~BatchScheduler();
+
+    BatchScheduler(const BatchScheduler &) = delete;
+    BatchScheduler &operator=(const BatchScheduler &) = delete;
+
+    /*
+    Blocks until the batch holding probe has been matched and returns its
+    scores, or rethrows the error of the batch.
+    */
+    EncryptedScores match(EncryptedProbe probe);
+
+    /*
+    1:1 verification on the calling thread, never at the same time as a
+    batch since both use every worker of the engine.
+    */
+    seal::Ciphertext verify(const EncryptedProbe &probe, int identity);
+
+    BatchSchedulerStats stats() const;
+
+    void print(std::ostream &stream) const;
+
+private:
+    struct Request
+    {
+        EncryptedProbe probe;
+        std::promise<EncryptedScores> scores;
+        std::chrono::steady_clock::time_point arrival;
+    };
+
+    void run();
+
+    const MatchEngine &engine_;
+    std::size_t max_batch_;
+    std::chrono::microseconds deadline_;
+
+    // held while the engine evaluates
+    std::mutex engine_mutex_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::deque<Request> pending_;
+    bool stopping_ = false;
+
+    BatchSchedulerStats stats_;
+    double total_wait_ms_ = 0;
+
+    std::thread thread_;
+};
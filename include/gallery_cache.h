@@ -0,0 +1,102 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : gallery_cache.h
+//   Description : memory budgeted cache of gallery ciphertexts with least
+//                 recently used eviction for lookups and no eviction for
+//                 scans, misses are reloaded from the gallery container on
+//                 demand
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+#include "seal/seal.h"
+
+struct GalleryCacheStats
+{
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+
+    // scan misses returned without being cached
+    std::size_t bypassed = 0;
+
+    std::size_t entries = 0;
+    std::size_t bytes = 0;
+    std::size_t budget = 0;
+};
+
+/*
+A match reads every gallery ciphertext in the same order each time, and LRU
+would evict each one just before its next use. Scans therefore never evict:
+a scan miss is cached only while the budget has room and bypasses the cache
+otherwise, so the ciphertexts that fit stay pinned for every later scan.
+Lookups of single ciphertexts, 1:1 verification, evict the least recently
+used ones to make room, so frequently claimed identities stay resident.
+
+Ciphertexts are handed out as shared pointers, so one evicted while a worker
+still matches against it stays alive until the worker is done. A ciphertext
+larger than the whole budget is returned without being cached. Two workers
+missing the same key at once both load it, the second keeps the first copy.
+*/
+class GalleryCache
+{
+public:
+    using Loader = std::function<seal::Ciphertext(std::uint64_t)>;
+
+    explicit GalleryCache(std::size_t budget);
+
+    /*
+    The cached ciphertext of key, or the one load(key) returns on a miss.
+    scan says the access is part of a pass over the whole gallery.
+    */
+    std::shared_ptr<const seal::Ciphertext> get(std::uint64_t key, const Loader &load, bool scan = false);
+
+    /*
+    Drops every cached ciphertext, after the gallery on disk has changed.
+    */
+    void clear();
+
+    GalleryCacheStats stats() const;
+
+    void print(std::ostream &stream) const;
+
+    /*
+    Memory held by the polynomials of a ciphertext.
+    */
+    static std::size_t footprint(const seal::Ciphertext &encrypted);
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const seal::Ciphertext> encrypted;
+        std::size_t bytes;
+        std::list<std::uint64_t>::iterator position;
+    };
+
+    std::size_t budget_;
+
+    mutable std::mutex mutex_;
+
+    // most recently used key first
+    std::list<std::uint64_t> recency_;
+    std::unordered_map<std::uint64_t, Entry> entries_;
+    std::size_t bytes_ = 0;
+
+    std::size_t hits_ = 0;
+    std::size_t misses_ = 0;
+    std::size_t evictions_ = 0;
+    std::size_t bypassed_ = 0;
+};
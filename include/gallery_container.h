@@ -0,0 +1,218 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : gallery_container.h
+//   Description : single-file indexed container for an encrypted gallery,
+//                 a versioned header with the encryption parameters, an
+//                 offset table keyed by identity (1:1) or by block and
+//                 dimension (1:N) and contiguous ciphertext payloads
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "seal/seal.h"
+#include "gallery_io.h"
+
+/*
+On-disk layout, little endian:
+
+    header              GalleryHeader, 80 bytes
+    payloads            serialized ciphertexts, back to back
+    offset table        table_count GalleryEntry records
+
+Appending writes the new payloads and a new offset table after the current
+end of the file, then rewrites the header to point at the new table. A crash
+before the header is rewritten leaves the previous table in effect, even for
+a commit with no payload appended. Appending an existing key replaces its
+payload, the old bytes and the superseded tables are dead until compact()
+copies the live payloads to a fresh file, which commit() does once they pass
+compact_fraction of the file.
+*/
+struct GalleryHeader
+{
+    char magic[4] = { 'S', 'F', 'M', 'G' };
+    std::uint32_t version = 1;
+    std::uint8_t scheme = 0;
+    std::uint8_t mode = 0;
+    std::uint8_t layout = 0;
+    std::uint8_t probe_format = 0;
+    std::uint32_t dim = 0;
+    std::uint64_t poly_modulus_degree = 0;
+    seal::parms_id_type parms_id = {};
+    std::uint64_t num_templates = 0;
+    std::uint64_t table_offset = 0;
+    std::uint64_t table_count = 0;
+};
+
+struct GalleryEntry
+{
+    std::uint64_t key;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+/*
+Key of the free-slot map of a 1:N gallery, the revoked slots as uint64
+values. It is never a ciphertext and is skipped when streaming.
+*/
+const std::uint64_t free_slots_key = UINT64_MAX;
+
+static_assert(sizeof(GalleryHeader) == 80, "GalleryHeader must not be padded");
+static_assert(sizeof(GalleryEntry) == 24, "GalleryEntry must not be padded");
+
+class GalleryContainer
+{
+public:
+    /*
+    Creates an empty container, replacing any existing file.
+    */
+    static void create(const std::string &name, const GalleryHeader &header);
+
+    /*
+    Opens a container. The offset table is read into a hash map for O(1)
+    lookup and the payloads are memory mapped.
+    */
+    explicit GalleryContainer(const std::string &name, bool writable = false);
+
+    ~GalleryContainer();
+
+    GalleryContainer(const GalleryContainer &) = delete;
+    GalleryContainer &operator=(const GalleryContainer &) = delete;
+
+    const GalleryHeader &header() const
+    {
+        return header_;
+    }
+
+    std::size_t size() const
+    {
+        return order_.size();
+    }
+
+    bool contains(std::uint64_t key) const
+    {
+        return index_.count(key) != 0;
+    }
+
+    /*
+    Keys in file order, which is the order to stream the gallery in.
+    */
+    const std::vector<std::uint64_t> &keys() const
+    {
+        return order_;
+    }
+
+    /*
+    Zero-copy view of the serialized payload of a key.
+    */
+    std::pair<const seal::seal_byte *, std::size_t> payload(std::uint64_t key) const;
+
+    template <class T>
+    void load(const seal::SEALContext &context, std::uint64_t key, T &object) const
+    {
+        auto bytes = payload(key);
+        object.load(context, bytes.first, bytes.second);
+    }
+
+    /*
+    Appends a payload under key. It becomes visible to readers after commit().
+    */
+    void append_bytes(std::uint64_t key, const seal::seal_byte *data, std::size_t size);
+
+    /*
+    Overwrites the committed payload of key in place when size bytes fit in
+    its slot and returns false otherwise. Unlike an append this is not
+    atomic: a crash can leave part of the new payload over the old one, and
+    readers mapping the file may see it before commit().
+    */
+    bool replace_bytes(std::uint64_t key, const seal::seal_byte *data, std::size_t size);
+
+    template <class T>
+    std::size_t append(
+        std::uint64_t key, const T &object,
+        seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default)
+    {
+        std::vector<seal::seal_byte> buffer = save_to_buffer(object, compr_mode);
+        append_bytes(key, buffer.data(), buffer.size());
+        return buffer.size();
+    }
+
+    void set_num_templates(std::uint64_t num_templates)
+    {
+        header_.num_templates = num_templates;
+    }
+
+    /*
+    Writes the offset table and the header and remaps the file, compacting
+    it when dead bytes pass compact_fraction of it.
+    */
+    void commit();
+
+    /*
+    Makes the payloads appended since the last commit() or sync() durable
+    and appends their entries to the side log instead of writing a new
+    offset table, so a long run of appends writes every entry once.
+    */
+    void sync(const std::string &log);
+
+    /*
+    Adopts the entries a previous run logged with sync(), up to the first
+    one that does not lie in the file past the table in effect. The next
+    commit() writes them into the table, the log is then the caller's to
+    remove.
+    */
+    void recover(const std::string &log);
+
+    /*
+    Bytes of superseded payloads and offset tables as of the last commit.
+    */
+    std::uint64_t dead_bytes() const
+    {
+        return dead_;
+    }
+
+    /*
+    Commits pending appends, copies the header, the live payloads in key
+    order and the table to a new file and renames it over this one.
+    */
+    void compact();
+
+    static constexpr double compact_fraction = 0.5;
+
+private:
+    void read_table();
+
+    void write_table();
+
+    // end of the table in effect, where appends start after a commit
+    std::uint64_t committed_end() const
+    {
+        return header_.table_offset + header_.table_count * sizeof(GalleryEntry);
+    }
+
+    void count_dead();
+
+    std::string name_;
+    bool writable_ = false;
+    int fd_ = -1;
+    GalleryHeader header_;
+    std::unordered_map<std::uint64_t, GalleryEntry> index_;
+    std::vector<std::uint64_t> order_;
+    MappedFile mapping_;
+    std::uint64_t end_ = 0;
+    std::uint64_t dead_ = 0;
+    bool dirty_ = false;
+
+    // appended since the last commit() or sync()
+    std::vector<GalleryEntry> unsynced_;
+};
@@ -0,0 +1,135 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : gallery_io.h
+//   Description : zero-copy file I/O for SEAL objects, loads deserialize
+//                 straight from a read-only memory map of the file and saves
+//                 serialize straight into a writable mapping of the output
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+
+/*
+Read-only memory map of a whole file.
+*/
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &name);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    const seal::seal_byte *data() const
+    {
+        return static_cast<const seal::seal_byte *>(data_);
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    void unmap();
+
+    void *data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+/*
+Writable memory map of a new file of at most capacity bytes. finish() unmaps
+it and truncates the file to the bytes actually written.
+*/
+class MappedOutputFile
+{
+public:
+    MappedOutputFile(const std::string &name, std::size_t capacity);
+
+    ~MappedOutputFile();
+
+    MappedOutputFile(const MappedOutputFile &) = delete;
+    MappedOutputFile &operator=(const MappedOutputFile &) = delete;
+
+    seal::seal_byte *data()
+    {
+        return static_cast<seal::seal_byte *>(data_);
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    void finish(std::size_t size);
+
+private:
+    std::string name_;
+    int fd_ = -1;
+    void *data_ = nullptr;
+    std::size_t capacity_ = 0;
+};
+
+/*
+Loads a SEAL object (ciphertext or key) from the mapped bytes of a file without
+copying them into a stream first.
+*/
+template <class T>
+void load_from_file(const seal::SEALContext &context, T &object, const std::string &name, bool unsafe = false)
+{
+    MappedFile file(name);
+    if (unsafe)
+    {
+        object.unsafe_load(context, file.data(), file.size());
+    }
+    else
+    {
+        object.load(context, file.data(), file.size());
+    }
+}
+
+/*
+Saves a SEAL object (or a seal::Serializable) straight into the output file
+and returns the number of bytes written.
+*/
+template <class T>
+std::size_t save_to_file(
+    const T &object, const std::string &name,
+    seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default)
+{
+    MappedOutputFile file(name, static_cast<std::size_t>(object.save_size(compr_mode)));
+    std::size_t size = static_cast<std::size_t>(object.save(file.data(), file.capacity(), compr_mode));
+    file.finish(size);
+    return size;
+}
+
+/*
+Serializes a SEAL object (or a seal::Serializable) into a byte buffer.
+*/
+template <class T>
+std::vector<seal::seal_byte> save_to_buffer(
+    const T &object, seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default)
+{
+    std::vector<seal::seal_byte> buffer(static_cast<std::size_t>(object.save_size(compr_mode)));
+    buffer.resize(static_cast<std::size_t>(object.save(buffer.data(), buffer.size(), compr_mode)));
+    return buffer;
+}
+
+/*
+Writes already serialized bytes to a file and returns their number.
+*/
+std::size_t save_bytes_to_file(const std::vector<seal::seal_byte> &bytes, const std::string &name);
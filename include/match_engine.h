@@ -0,0 +1,742 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : match_engine.h
+//   Description : persistent matching engine, holds the SEAL context, keys,
+//                 encoders and the resident encrypted gallery so that one
+//                 process can enroll or match many templates without
+//                 rebuilding the context or reloading keys for each one
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+#include "gallery_container.h"
+#include "noise_tracker.h"
+#include "zero_pool.h"
+#include "gallery_cache.h"
+#include "worker_pool.h"
+
+/*
+1:1 matching stores one ciphertext per enrolled template, 1:N matching stores
+one ciphertext per feature dimension holding that dimension of every template.
+*/
+enum class MatchMode
+{
+    one_to_one,
+    one_to_n
+};
+
+/*
+The standard 1:1 layout puts one template at the start of each ciphertext.
+The packed 1:1 layout splits the slots into segments of dim rounded up to a
+power of two and puts one template in every segment, so a single multiply,
+relinearization and rotation tree scores slot_count / segment templates.
+The replicated 1:N layout repeats a gallery of N <= slot_count templates
+slot_count / N times in every dimension ciphertext, so one pass of the
+dimension loop scores a batch of that many probes, each broadcast into its
+own replica.
+*/
+enum class GalleryLayout
+{
+    standard,
+    packed,
+    replicated
+};
+
+/*
+A broadcast 1:N probe is one ciphertext per feature dimension with the value
+of that dimension in every slot. A packed 1:N probe is a single ciphertext
+holding the probe repeated with period dim rounded up to a power of two; the
+server expands the per-dimension broadcasts from it with a plaintext mask
+and a rotate-and-sum, which needs Galois keys.
+*/
+enum class ProbeFormat
+{
+    broadcast,
+    packed
+};
+
+/*
+When the 1:N dimension loop relinearizes (and for CKKS rescales) the products.
+Eager does it after every multiplication, deferred sums the size 3 products and
+does it once per probe, none never relinearizes and leaves the size 3 score
+ciphertext to the decryptor.
+*/
+enum class RelinPolicy
+{
+    eager,
+    deferred,
+    none
+};
+
+struct MatchConfig
+{
+    seal::scheme_type scheme = seal::scheme_type::bfv;
+    MatchMode mode = MatchMode::one_to_one;
+    GalleryLayout layout = GalleryLayout::standard;
+    ProbeFormat probe_format = ProbeFormat::broadcast;
+    RelinPolicy relin_policy = RelinPolicy::deferred;
+    int security_level = 128;
+
+    // explicit encryption parameters, usually from a parameter file written
+    // by the planner; a zero degree or an empty chain keeps the defaults
+    std::size_t poly_modulus_degree = 0;
+    std::vector<int> coeff_modulus_bits;
+    int plain_modulus_bits = 20;
+
+    // precision of 1/125 = 0.004, features are quantized with it for BFV
+    float precision = 125;
+
+    // CKKS encoding scales of the gallery and the probe
+    double gallery_scale = pow(2.0, 32);
+    double probe_scale = pow(2.0, 32);
+
+    // the expansion of a packed CKKS 1:N probe uses up one level, so the
+    // product with the gallery has to fit in a smaller coefficient modulus
+    double packed_probe_scale = pow(2.0, 16);
+
+    std::string key_dir = "../data/keys/";
+    std::string gallery_dir = "../data/gallery/";
+
+    // print progress the way the enrollment and authentication binaries always have
+    bool verbose = true;
+
+    // number of worker threads that evaluate one probe, 0 uses every core
+    int num_workers = 1;
+
+    // compression of every saved key and gallery ciphertext
+    seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default;
+
+    // save seeded keys and encrypt the gallery symmetrically as seeded
+    // ciphertexts, which halves the public, relin and Galois keys and the
+    // gallery on disk
+    bool compact = false;
+
+    // score ciphertexts are switched to the lowest level that still decrypts
+    // them correctly before they are returned
+    bool switch_results = true;
+
+    // record BFV noise budgets after every evaluation stage, see NoiseTracker
+    bool track_noise = false;
+
+    // CKKS only: the server compares the scores with threshold under
+    // encryption and returns 1 for a match and 0 otherwise instead of the
+    // scores, each iteration of the sign approximation costs two levels
+    bool threshold_decision = false;
+    float threshold = 0;
+    int threshold_iterations = 4;
+
+    // authentication streams the gallery from the container instead of
+    // loading it: prefetch_threads deserialize up to prefetch_depth gallery
+    // ciphertexts ahead of the workers, which bounds memory and hides the
+    // disk reads behind the evaluation
+    bool stream_gallery = false;
+    int prefetch_depth = 16;
+    int prefetch_threads = 1;
+
+    // probes are encrypted as a precomputed encryption of zero plus the
+    // plaintext, zero_pool_depth encryptions of zero are kept ready by
+    // zero_pool_threads background threads, 0 encrypts probes directly
+    int zero_pool_depth = 0;
+    int zero_pool_threads = 1;
+
+    // authentication keeps at most cache_bytes of gallery ciphertexts in
+    // memory, evicting the least recently used and reloading them from the
+    // container on demand, 0 loads the whole gallery
+    std::size_t cache_bytes = 0;
+
+    // keep the plaintext masks of the evaluation pre-encoded and in NTT form
+    // at the level they are applied, built once when the gallery is loaded
+    // instead of for every probe; the 1:N probe expansion masks take dim
+    // plaintexts of memory
+    bool resident = false;
+
+    // Galois keys are generated for rotations by powers of rotation_base (a
+    // power of two) only, a larger base shrinks the keys and composes the
+    // other rotations of the rotation tree from several key switches
+    std::size_t rotation_base = 2;
+
+    // the matching server coalesces probes that arrive within
+    // batch_deadline_us microseconds into batches of up to max_batch probes,
+    // 0 matches every probe on its own; the client keeps connections
+    // requests in flight
+    int batch_deadline_us = 0;
+    int max_batch = 16;
+    int connections = 1;
+
+    // enrollment appends to the existing gallery instead of replacing it
+    bool append = false;
+
+    // enrollment encrypts on every worker while a writer thread fills the
+    // container, committing and checkpointing every checkpoint_every
+    // ciphertexts so that an interrupted run resumes
+    bool bulk = false;
+    int checkpoint_every = 1024;
+
+    // 1:N enrollment revokes these identities, or replaces replace_identity
+    // with the first template of the gallery file
+    std::vector<std::size_t> revoke;
+    int replace_identity = -1;
+
+    // 1:1 authentication verifies every probe against this identity only
+    int claimed_identity = -1;
+};
+
+/*
+Default configuration of each of the eight enrollment/authentication binaries.
+*/
+MatchConfig default_config(seal::scheme_type scheme, MatchMode mode, int security_level);
+
+/*
+Scheme ("bfv" or "ckks") and mode ("1-to-1" or "1-to-n") as given on the
+command line, false for anything else.
+*/
+bool parse_scheme_mode(const std::string &scheme, const std::string &mode, seal::scheme_type &parsed_scheme, MatchMode &parsed_mode);
+
+/*
+Encryption parameters for a configuration. Unless they come from a parameter
+file these parameters have not been optimized for speed.
+*/
+seal::EncryptionParameters make_parameters(const MatchConfig &config);
+
+seal::sec_level_type to_sec_level(int security_level);
+
+std::size_t next_power_of_two(std::size_t value);
+
+/*
+Parses the optional command line flags that follow the positional arguments
+of a binary, starting at argv[first]:
+
+    --workers N     evaluate with N threads (0 uses every core)
+    --packed        packed 1:1 gallery layout
+    --packed-probe  single ciphertext 1:N probes
+    --replicated    replicated 1:N gallery layout for batches of probes
+    --relin P       1:N relinearization policy: eager, deferred or none
+    --compact       seeded keys and symmetrically encrypted gallery
+    --compr M       compression of saved objects: none, zlib or zstd
+    --full-results  return scores at the level the computation left them
+    --params FILE   encryption parameters, scales and layout from a planner file
+    --precision P   BFV quantization precision
+    --noise         track noise budgets and score errors
+    --threshold T   CKKS: return encrypted match decisions at threshold T
+    --threshold-iterations K
+                    sign approximation iterations of the threshold
+    --rotation-base B
+                    generate Galois keys for rotations by powers of B only
+    --resident      keep the evaluation masks pre-encoded in NTT form
+    --zero-pool N   keep N encryptions of zero ready for probe encryption
+    --zero-pool-threads N
+                    threads refilling the zero pool
+    --cache-mb N    keep at most N MB of the gallery in memory
+    --stream        stream the gallery from disk while matching
+    --prefetch-depth N
+                    gallery ciphertexts read ahead when streaming
+    --prefetch-threads N
+                    threads reading the gallery when streaming
+    --batch-deadline US
+                    server: batch the probes arriving within US microseconds
+    --max-batch N   server: at most N probes per batch
+    --connections N client: send probes over N concurrent connections
+    --append        enroll into the existing gallery with the existing keys
+    --bulk          enroll in parallel, resuming an interrupted bulk run
+    --checkpoint-every N
+                    bulk: commit the gallery every N ciphertexts
+    --revoke ID[,ID...]
+                    1:N: revoke identities of the existing gallery
+    --replace ID    1:N: replace identity ID with the first template
+    --claim ID      verify 1:1 probes against identity ID only
+*/
+void parse_options(int argc, char **argv, int first, MatchConfig &config);
+
+/*
+Feature files written by data/gendata.py. The 1:1 files hold (num, dim) followed
+by num rows of dim floats, the 1:N files hold (dim, num) followed by dim rows of
+num floats. Both readers return one row of dim floats per template.
+*/
+std::vector<std::vector<float>> read_features(const std::string &name);
+std::vector<std::vector<float>> read_features_transposed(const std::string &name);
+
+/*
+An encrypted probe is a single ciphertext for 1:1 matching and one broadcast
+ciphertext per feature dimension (or a single packed ciphertext) for 1:N
+matching. Match results are one ciphertext per gallery ciphertext for 1:1 (one
+template, or one template per segment when packed) and one score vector per
+gallery block of slot_count templates for 1:N.
+*/
+using EncryptedProbe = std::vector<seal::Ciphertext>;
+using EncryptedScores = std::vector<seal::Ciphertext>;
+
+class MatchEngine
+{
+public:
+    explicit MatchEngine(const MatchConfig &config);
+
+    /*
+    Key management. Enrollment generates and saves the keys once, authentication
+    loads them back from config.key_dir. Galois keys cover only the rotations
+    the layout needs for templates of dimension dim, 0 covers a whole row.
+    */
+    void generate_keys(int dim = 0);
+    void save_keys() const;
+    void load_keys();
+
+    /*
+    Loads the public, relinearization and Galois keys only, which is all
+    the matching server needs. There is no decryptor and no noise tracking
+    then, and anything that needs the secret key throws.
+    */
+    void load_public_keys();
+
+    /*
+    Encrypts the given templates, keeps them resident and writes them to a
+    single container file in config.gallery_dir. With config.bulk they are
+    encrypted on every worker and only written, the gallery is then opened
+    but not loaded.
+    */
+    void enroll(const std::vector<std::vector<float>> &templates);
+
+    /*
+    A bulk enrollment left a checkpoint next to the container, enroll()
+    resumes it with the keys it saved.
+    */
+    bool enrollment_interrupted() const;
+
+    /*
+    Encrypts more templates into the enrolled container and returns their
+    identities, which continue from the enrolled count. For 1:N the
+    templates are added into the stored dimension ciphertexts, reusing
+    revoked slots first.
+    */
+    std::vector<std::size_t> append(const std::vector<std::vector<float>> &templates);
+
+    /*
+    1:N only: zeroes the slots of the given identities in every dimension
+    ciphertext and records them in the free-slot map of the container, so
+    that append() reuses them. Their scores are 0 from then on.
+    */
+    void revoke(const std::vector<std::size_t> &identities);
+
+    /*
+    1:N only: revokes identity and adds gallery in its slot.
+    */
+    void replace(std::size_t identity, const std::vector<float> &gallery);
+
+    /*
+    Revoked 1:N slots not reused yet.
+    */
+    const std::set<std::size_t> &free_slots() const
+    {
+        return free_slots_;
+    }
+
+    /*
+    Opens the gallery container and checks it against the configuration
+    without reading any ciphertext, enough for verify().
+    */
+    void open_gallery();
+
+    /*
+    The layout of the gallery as the container header stores it, and the
+    other side: a client sets up the layout of the scores from the header the
+    matching server sends, without the gallery container.
+    */
+    GalleryHeader gallery_header() const;
+    void use_layout(const GalleryHeader &header);
+
+    /*
+    Loads every enrolled template, or the first num_gallery templates of
+    dimension dim.
+    */
+    void load_gallery();
+    void load_gallery(int num_gallery, int dim);
+
+    EncryptedProbe encrypt_probe(const std::vector<float> &probe) const;
+
+    /*
+    Largest message frame an encrypted probe can take on the wire, the
+    matching server drops larger requests before reading them.
+    */
+    std::size_t max_probe_frame() const;
+
+    /*
+    Ciphertexts in an encrypted probe: dim for broadcast 1:N probes, 1
+    otherwise. check_probe throws invalid_argument for any other count.
+    */
+    std::size_t probe_ciphertexts() const;
+    void check_probe(const EncryptedProbe &probe) const;
+
+    EncryptedScores match(const EncryptedProbe &probe) const;
+
+    /*
+    Matches several probes in one pass over the gallery, every gallery
+    ciphertext is read once for the whole batch. The scores of probe i are
+    the same as match(probes[i]) returns.
+    */
+    std::vector<EncryptedScores> match_batch(const std::vector<EncryptedProbe> &probes) const;
+
+    /*
+    Replicated 1:N layout: encrypts up to probes_per_batch() probes into one
+    probe, match() scores all of them in one pass and decrypt_batch_scores
+    splits the result into one score vector per probe.
+    */
+    EncryptedProbe encrypt_probes(const std::vector<std::vector<float>> &probes) const;
+    std::vector<std::vector<float>> decrypt_batch_scores(const EncryptedScores &scores, std::size_t num_probes) const;
+
+    std::size_t probes_per_batch() const
+    {
+        return replicas();
+    }
+
+    /*
+    1:1 verification against a claimed identity, only the ciphertext holding
+    that identity is read. decrypt_score returns its score.
+    */
+    seal::Ciphertext verify(const EncryptedProbe &probe, int identity) const;
+    float decrypt_score(const seal::Ciphertext &score, int identity) const;
+
+    /*
+    Serialized size of match results, what a server would send back.
+    */
+    std::size_t serialized_size(const EncryptedScores &scores) const;
+
+    /*
+    Noise budgets and score errors of the run when config.track_noise is
+    set, nullptr otherwise.
+    */
+    NoiseTracker *noise_tracker() const
+    {
+        return noise_tracker_.get();
+    }
+
+    /*
+    Pool of encryptions of zero, null unless config.zero_pool_depth is set.
+    */
+    ZeroPool *zero_pool() const
+    {
+        return zero_pool_.get();
+    }
+
+    /*
+    Gallery cache, null unless config.cache_bytes is set and the gallery was
+    loaded.
+    */
+    GalleryCache *gallery_cache() const
+    {
+        return gallery_cache_.get();
+    }
+
+    /*
+    Decrypts match results into one score per gallery template.
+    */
+    std::vector<float> decrypt_scores(const EncryptedScores &scores) const;
+
+    const MatchConfig &config() const
+    {
+        return config_;
+    }
+
+    const seal::SEALContext &context() const
+    {
+        return context_;
+    }
+
+    std::size_t slot_count() const;
+
+    /*
+    Slots per template segment and templates per gallery ciphertext of the
+    packed 1:1 layout.
+    */
+    std::size_t segment_width() const;
+    std::size_t templates_per_ciphertext() const;
+
+    /*
+    1:N galleries larger than slot_count are split into blocks of slot_count
+    templates, each with one ciphertext per dimension.
+    */
+    std::size_t num_blocks() const;
+
+    /*
+    Copies of the gallery in every ciphertext of the replicated layout, 1 for
+    the other layouts.
+    */
+    std::size_t replicas() const;
+
+    int num_gallery() const
+    {
+        return num_gallery_;
+    }
+
+    int dim() const
+    {
+        return dim_;
+    }
+
+    /*
+    Whether the layout rotates at all, the width of its rotation trees for
+    templates of dimension dim, and the rotation steps that get Galois keys
+    for it.
+    */
+    bool uses_galois_keys() const
+    {
+        return config_.mode == MatchMode::one_to_one or config_.probe_format == ProbeFormat::packed;
+    }
+
+    std::size_t rotation_width(int dim) const;
+    std::vector<int> galois_steps(int dim) const;
+
+private:
+    std::string key_name(const std::string &kind) const;
+
+    std::string container_name() const;
+
+    // whether a gallery with this header was enrolled under the configuration
+    bool matches_configuration(const GalleryHeader &header) const;
+
+    // progress file of a bulk enrollment, next to the container
+    std::string checkpoint_name() const;
+
+    /*
+    Plaintext of the gallery ciphertext under key for the configured layout.
+    */
+    seal::Plaintext gallery_plaintext(const std::vector<std::vector<float>> &templates, std::size_t key) const;
+
+    void enroll_bulk(const std::vector<std::vector<float>> &templates);
+
+    /*
+    Encrypts a gallery plaintext, appends it to the container under key and
+    returns the bytes written.
+    */
+    std::size_t store_gallery(std::uint64_t key, const seal::Plaintext &plain, seal::Ciphertext &encrypted);
+
+    seal::Plaintext encode(const std::vector<float> &values, std::size_t width, double scale) const;
+
+    seal::Plaintext encode_broadcast(float value, double scale) const;
+
+    /*
+    Copies values into every segment of a slot vector.
+    */
+    std::vector<float> tile(const std::vector<float> &values, std::size_t segment) const;
+
+    /*
+    Every worker thread owns its evaluator and memory pool so the workers never
+    contend on the global pool.
+    */
+    struct Worker
+    {
+        explicit Worker(const seal::SEALContext &context);
+
+        seal::MemoryPoolHandle pool;
+        seal::Evaluator evaluator;
+        std::unique_ptr<seal::Encryptor> encryptor;
+        std::unique_ptr<seal::Decryptor> decryptor;
+    };
+
+    void load_key_files(bool with_secret_key);
+
+    void set_keys();
+
+    // throws a logic_error naming operation when the secret key is not loaded
+    void require_secret_key(const std::string &operation) const;
+
+    /*
+    Reopens the container for writing, opening the gallery first if needed.
+    */
+    void open_for_update();
+
+    /*
+    Writes a gallery payload over the previous one of key when it fits,
+    else appends it.
+    */
+    void write_gallery(std::uint64_t key, const std::vector<seal::seal_byte> &bytes);
+
+    /*
+    Sets the 1:N slots in updates to their template, or to zero for a null
+    template, and writes the touched dimension ciphertexts and the free-slot
+    map. Slots below the enrolled count that are not free are cleared first,
+    for BFV by a 0/1 plaintext mask and for CKKS by subtracting their
+    decrypted values. Slots past it grow the gallery.
+    */
+    void update_columns(const std::map<std::size_t, const std::vector<float> *> &updates);
+
+    /*
+    Encrypts a probe plaintext with the encryptor of worker, or from the zero
+    pool when there is one.
+    */
+    void encrypt(Worker &worker, const seal::Plaintext &plain, seal::Ciphertext &destination) const;
+
+    /*
+    Runs body(w, i) for i in [0, count) on the calling thread and the worker
+    pool, handing out indices dynamically. w is the index of the worker
+    running i.
+    */
+    void parallel_for(std::size_t count, const std::function<void(std::size_t, std::size_t)> &body) const;
+
+    /*
+    Sums the ciphertexts of a 1:N partial sum vector pairwise, log2(n) rounds
+    each run in parallel, the total ends up in sums[0].
+    */
+    void tree_reduce(std::vector<seal::Ciphertext> &sums) const;
+
+    /*
+    Adds rotations by 1, 2, 4, ..., width / 2 so that slot i holds the sum of
+    slots i to i + width - 1.
+    */
+    void rotate_sum(Worker &worker, seal::Ciphertext &encrypted, std::size_t width) const;
+
+    /*
+    Rotates left by step, a power of two, as a chain of rotations by the
+    largest steps that have Galois keys.
+    */
+    void rotate(Worker &worker, const seal::Ciphertext &encrypted, std::size_t step, seal::Ciphertext &destination) const;
+
+    /*
+    Builds the plaintexts that depend only on the gallery dimension.
+    */
+    void prepare_layout();
+
+    /*
+    Brings the resident gallery to the level the probe arrives at,
+    prepare_ciphertext does it for one gallery ciphertext.
+    */
+    void prepare_gallery();
+    void prepare_ciphertext(Worker &worker, seal::Ciphertext &encrypted) const;
+
+    /*
+    Number of gallery ciphertexts match() reads for num_gallery() templates.
+    */
+    std::size_t gallery_ciphertexts() const;
+
+    /*
+    Gallery ciphertext key through the cache, loaded and prepared by worker
+    on a miss. match() reads the whole gallery as a scan, verify() a single
+    ciphertext as a lookup.
+    */
+    std::shared_ptr<const seal::Ciphertext> cached_gallery(Worker &worker, std::uint64_t key, bool scan) const;
+
+    /*
+    Streams gallery ciphertexts [0, count) out of the container: prefetch
+    threads deserialize them into a bounded queue and the workers run
+    body(w, i, encrypted) on them in arrival order.
+    */
+    void scan_gallery(
+        std::size_t count, const std::function<void(std::size_t, std::size_t, const seal::Ciphertext &)> &body) const;
+
+    /*
+    match() and match_batch() share this, one pass over the gallery for all
+    of the probes.
+    */
+    std::vector<EncryptedScores> match_probes(const std::vector<const EncryptedProbe *> &probes) const;
+
+    /*
+    Broadcasts dimension j of a packed 1:N probe to every slot.
+    */
+    seal::Ciphertext expand_probe(Worker &worker, const seal::Ciphertext &packed, std::size_t j) const;
+
+    /*
+    Mask keeping the slots of a packed probe that hold dimension j, encoded
+    for a probe at parms_id.
+    */
+    seal::Plaintext expansion_mask(Worker &worker, std::size_t j, seal::parms_id_type parms_id) const;
+
+    /*
+    Scores a 1:1 probe against one gallery ciphertext.
+    */
+    seal::Ciphertext match_one(Worker &worker, const seal::Ciphertext &probe, const seal::Ciphertext &gallery) const;
+
+    /*
+    Switches a score ciphertext down the modulus chain, which shrinks it and
+    speeds up its decryption.
+    */
+    void switch_result(Worker &worker, seal::Ciphertext &encrypted) const;
+
+    /*
+    Level switch_result() takes encrypted to.
+    */
+    seal::parms_id_type result_level(const seal::Ciphertext &encrypted) const;
+
+    /*
+    BFV: whether a match against the updated columns of a block still
+    decrypts, judged from the column with the least noise budget multiplied
+    with a fresh probe.
+    */
+    bool budget_suffices(Worker &worker, const std::vector<seal::Ciphertext> &columns) const;
+
+    /*
+    Replaces CKKS scores by approximate 0/1 match decisions in the slots
+    where mask is 1 and by 0 elsewhere.
+    */
+    void apply_threshold(Worker &worker, seal::Ciphertext &encrypted, const std::vector<double> &mask) const;
+
+    /*
+    Records the noise budget of a ciphertext after stage when tracking.
+    */
+    void track(Worker &worker, const char *stage, const seal::Ciphertext &encrypted) const;
+
+    // bits of coefficient modulus kept above what a switched score needs
+    static constexpr int result_margin_bits = 10;
+
+    std::vector<double> decrypt_slots(Worker &worker, const seal::Ciphertext &encrypted) const;
+
+    MatchConfig config_;
+    seal::EncryptionParameters parms_;
+    seal::SEALContext context_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::unique_ptr<WorkerPool> worker_pool_;
+
+    std::unique_ptr<seal::BatchEncoder> batch_encoder_;
+    std::unique_ptr<seal::CKKSEncoder> ckks_encoder_;
+
+    seal::PublicKey public_key_;
+    seal::SecretKey secret_key_;
+    seal::RelinKeys relin_key_;
+    seal::GaloisKeys gal_key_;
+
+    // false when only the public keys were loaded
+    bool has_secret_key_ = false;
+
+    // rotation steps with a Galois key, ascending
+    std::vector<std::size_t> key_steps_;
+
+    // serialized seeded keys of a compact enrollment, by key kind
+    std::map<std::string, std::vector<seal::seal_byte>> seeded_keys_;
+
+    // 1 at the first slot of every segment of the packed 1:1 layout (BFV)
+    seal::Plaintext segment_mask_;
+
+    // resident mode: the expansion mask of every dimension, in NTT form
+    std::vector<seal::Plaintext> expansion_masks_;
+
+    // 1 at the slots of the 1:1 scores, for the threshold decision
+    std::vector<double> threshold_mask_;
+
+    std::unique_ptr<GalleryContainer> container_;
+    std::unique_ptr<NoiseTracker> noise_tracker_;
+    std::unique_ptr<ZeroPool> zero_pool_;
+    std::unique_ptr<GalleryCache> gallery_cache_;
+    std::vector<seal::Ciphertext> gallery_;
+
+    // the gallery is read from container_ by scan_gallery() for every probe
+    bool streamed_ = false;
+    int num_gallery_ = 0;
+    int dim_ = 0;
+
+    // slots per gallery replica, the enrolled gallery size
+    std::size_t region_ = 0;
+
+    // revoked 1:N slots, persisted under free_slots_key
+    std::set<std::size_t> free_slots_;
+};
@@ -0,0 +1,79 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : match_protocol.h
+//   Description : framing of the messages between the matching server and
+//                 its clients over a Unix domain socket, encrypted probes in
+//                 and encrypted scores out
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "seal/seal.h"
+
+/*
+Every message is one frame, little endian:
+
+    magic               'S', 'F', 'M', 'P'
+    type                std::uint32_t, a MessageType
+    argument            std::int64_t, the claimed identity of a verify request
+    count               std::uint32_t
+    count payloads      std::uint64_t size followed by size bytes
+
+Payloads are serialized ciphertexts, except for an error, whose single
+payload is the message text, and a layout. A layout request has no payloads
+and is answered with a layout whose single payload is the GalleryHeader of
+the served gallery, all a client needs besides its keys to encrypt probes
+and read the scores. A client may send any number of requests over one
+connection, each one is answered before the next is read.
+*/
+enum class MessageType : std::uint32_t
+{
+    match = 1,
+    verify = 2,
+    scores = 3,
+    error = 4,
+    layout = 5
+};
+
+struct Message
+{
+    MessageType type = MessageType::error;
+    std::int64_t argument = 0;
+    std::vector<std::vector<seal::seal_byte>> payloads;
+};
+
+void send_message(int fd, const Message &message);
+
+// default bound on the payloads of a frame, size fields included
+const std::uint64_t max_frame_size = std::uint64_t(1) << 32;
+
+/*
+Reads the next message. Returns false if the peer closed the connection
+before a new message, throws on a truncated or malformed one and on one
+whose payloads take more than max_size bytes. Payloads are read in chunks,
+a peer cannot make the reader allocate more than it has sent.
+*/
+bool receive_message(int fd, Message &message, std::uint64_t max_size = max_frame_size);
+
+std::vector<std::vector<seal::seal_byte>> serialize_ciphertexts(
+    const std::vector<seal::Ciphertext> &ciphertexts,
+    seal::compr_mode_type compr_mode = seal::Serialization::compr_mode_default);
+
+std::vector<seal::Ciphertext> deserialize_ciphertexts(
+    const seal::SEALContext &context, const std::vector<std::vector<seal::seal_byte>> &payloads);
+
+/*
+A listening socket at path, replacing a stale socket file, and a connection
+to one.
+*/
+int listen_unix(const std::string &path);
+int connect_unix(const std::string &path);
@@ -0,0 +1,83 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : noise_tracker.h
+//   Description : noise budget and score error bookkeeping for capacity
+//                 planning, BFV noise budgets per evaluation stage and score
+//                 errors against a plaintext reference
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+Inner products of a probe with every gallery template, the reference the
+decrypted scores are compared with. With quantize set the features are
+rounded to multiples of 1 / precision first, as BFV encodes them and as
+data/gendata.py prints them; BFV scores should then match exactly.
+*/
+std::vector<float> reference_scores(
+    const std::vector<float> &probe, const std::vector<std::vector<float>> &gallery, float precision, bool quantize);
+
+/*
+Collects statistics from every worker thread of a run. Budgets are in bits as
+returned by Decryptor::invariant_noise_budget, stages are reported in the
+order they were first seen.
+*/
+class NoiseTracker
+{
+public:
+    void record_budget(const std::string &stage, int budget);
+
+    void record_scores(const std::vector<float> &scores, const std::vector<float> &reference);
+
+    /*
+    Threshold decisions against the bitmap of the reference scores. A
+    decision is wrong when it rounds to the other side of 0.5, and the
+    largest distance from the bitmap shows a decision that wrapped around
+    its modulus.
+    */
+    void record_decisions(const std::vector<float> &decisions, const std::vector<float> &reference, float threshold);
+
+    /*
+    Smallest budget seen at any stage, the headroom left for smaller
+    parameters. -1 if no budget was recorded.
+    */
+    int min_budget() const;
+
+    void print(std::ostream &stream) const;
+
+private:
+    struct BudgetStats
+    {
+        int min = 0;
+        int max = 0;
+        double sum = 0;
+        std::size_t count = 0;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<std::string> stages_;
+    std::map<std::string, BudgetStats> budgets_;
+
+    std::size_t num_scores_ = 0;
+    double max_abs_error_ = 0;
+    double sum_abs_error_ = 0;
+    double sum_squared_error_ = 0;
+    double max_rel_error_ = 0;
+    std::size_t num_rel_ = 0;
+    double sum_rel_error_ = 0;
+
+    std::size_t num_decisions_ = 0;
+    std::size_t wrong_decisions_ = 0;
+    double max_decision_error_ = 0;
+};
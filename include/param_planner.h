@@ -0,0 +1,73 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : param_planner.h
+//   Description : chooses the smallest encryption parameters that keep a
+//                 matching configuration correct and writes them to the
+//                 parameter file read by enrollment and authentication
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "match_engine.h"
+
+/*
+Encryption parameters and CKKS scales chosen for one configuration. The noise
+and error model behind them is conservative rather than tight:
+
+BFV     the plain modulus holds the largest inner product of two quantized
+        unit-norm templates, (precision + sqrt(dim) / 2)^2, with its sign.
+        The coefficient modulus covers the plain modulus, fresh noise, one
+        ciphertext multiply, the plaintext masks of the layout, the sums of
+        the dimension loop or rotation tree and an 8 bit margin.
+
+CKKS    the scale keeps the encoding error of a score below 1 / (64 *
+        precision). 1:1 scores stay at the product scale, 1:N scores are
+        rescaled once (twice with a packed probe), each rescale uses up one
+        prime of the scale size. The threshold decision adds a prime for
+        every level it needs.
+
+Among the ring dimensions allowed by the security level, the one with the
+lowest estimated cost per probe for the given gallery size is chosen: small
+galleries favour small rings, 1:N galleries larger than the slot count favour
+the rings that need the fewest blocks.
+*/
+struct ParameterPlan
+{
+    float precision = 0;
+    std::size_t poly_modulus_degree = 0;
+    std::vector<int> coeff_modulus_bits;
+    int plain_modulus_bits = 0;
+
+    int gallery_scale_bits = 0;
+    int probe_scale_bits = 0;
+    int packed_probe_scale_bits = 0;
+
+    // gallery ciphertexts and estimated per-probe cost of the plan
+    std::size_t num_ciphertexts = 0;
+    double cost = 0;
+};
+
+ParameterPlan plan_parameters(const MatchConfig &config, int dim, int num_gallery);
+
+/*
+Sets the precision, encryption parameters and scales of a plan on a
+configuration.
+*/
+void apply_plan(const ParameterPlan &plan, MatchConfig &config);
+
+/*
+Parameter files are plain key=value lines, '#' starts a comment. They also
+record the layout and probe format the plan was made for. load_plan checks
+that the file was made for the scheme, mode and security level of the
+configuration, then applies the plan and its layout and probe format.
+*/
+void save_plan(const ParameterPlan &plan, const MatchConfig &config, const std::string &name);
+void load_plan(const std::string &name, MatchConfig &config);
@@ -0,0 +1,69 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : worker_pool.h
+//   Description : threads started once with the matching engine that run
+//                 its parallel loops, so that no probe starts or joins a
+//                 thread
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+num_threads threads waiting for loops. The thread that calls run() takes part
+as worker 0, the pool threads are workers 1 to num_threads. Loops from
+different threads take turns; a loop started from inside a loop body runs on
+the calling thread alone.
+*/
+class WorkerPool
+{
+public:
+    explicit WorkerPool(std::size_t num_threads);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /*
+    Runs body(w, i) for i in [0, count), handing out indices dynamically, and
+    returns once every index is done. w is the worker running i. The first
+    exception of a body is rethrown here.
+    */
+    void run(std::size_t count, const std::function<void(std::size_t, std::size_t)> &body);
+
+private:
+    void work(std::size_t w);
+
+    // one loop at a time
+    std::mutex run_mutex_;
+
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const std::function<void(std::size_t, std::size_t)> *body_ = nullptr;
+    std::size_t count_ = 0;
+    std::atomic<std::size_t> next_{ 0 };
+
+    // a new loop bumps the generation, participants pool threads join it
+    // and active of them are still running it
+    std::size_t generation_ = 0;
+    std::size_t participants_ = 0;
+    std::size_t active_ = 0;
+    std::exception_ptr error_;
+    bool stopping_ = false;
+
+    std::vector<std::thread> threads_;
+};
@@ -0,0 +1,80 @@
+///////////// Copyright 2018 Vishnu Boddeti. All rights reserved. /////////////
+//
+//   Project     : Secure Face Matching
+//   File        : zero_pool.h
+//   Description : offline pool of fresh public key encryptions of zero,
+//                 refilled in the background, so that encrypting a probe
+//                 online is an encode and a plaintext add
+//
+//   Created On: 10/17/2026
+//   Modified On: 10/17/2026
+////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+#include "seal/seal.h"
+#include "bounded_queue.h"
+
+struct ZeroPoolStats
+{
+    std::size_t depth = 0;
+    std::size_t capacity = 0;
+    std::size_t produced = 0;
+    std::size_t taken = 0;
+
+    // takes that found the pool empty and encrypted on the calling thread
+    std::size_t misses = 0;
+
+    // encryptions of zero per second the refill threads produce while busy
+    double refill_rate = 0;
+};
+
+/*
+Encrypting m is the same as adding the plaintext m to a fresh encryption of
+zero; BFV scales the plaintext by q / t in the add. Every ciphertext is taken
+once, reusing one would leak the difference of two probes.
+*/
+class ZeroPool
+{
+public:
+    ZeroPool(const seal::SEALContext &context, const seal::PublicKey &public_key, std::size_t capacity, int num_threads);
+
+    ~ZeroPool();
+
+    ZeroPool(const ZeroPool &) = delete;
+    ZeroPool &operator=(const ZeroPool &) = delete;
+
+    /*
+    A fresh encryption of zero at the first level. When the pool is empty
+    one is encrypted on the calling thread in pool instead.
+    */
+    seal::Ciphertext take(seal::MemoryPoolHandle pool);
+
+    /*
+    Encrypts plain as an encryption of zero from the pool plus plain.
+    */
+    void encrypt(
+        const seal::Evaluator &evaluator, const seal::Plaintext &plain, seal::Ciphertext &destination,
+        seal::MemoryPoolHandle pool);
+
+    ZeroPoolStats stats() const;
+
+    void print(std::ostream &stream) const;
+
+private:
+    seal::Encryptor encryptor_;
+    BoundedQueue<seal::Ciphertext> queue_;
+    std::vector<std::thread> threads_;
+
+    std::atomic<std::size_t> produced_{ 0 };
+    std::atomic<std::size_t> taken_{ 0 };
+    std::atomic<std::size_t> misses_{ 0 };
+    std::atomic<long long> busy_ns_{ 0 };
+};